@@ -1,4 +1,5 @@
 #include <fmpz_poly.h>
+#include "all_roots_in_interval.h"
 
 /* Based on code by Sebastian Pancratz from the FLINT repository.
  */
@@ -229,3 +230,327 @@ int _fmpz_poly_all_roots_real(fmpz *poly, slong n, fmpz *w)
 
     return 1;
 }
+
+/* Word-size versions of the above, for polynomials whose coefficients
+   fit in a signed word. Products are formed in 128-bit arithmetic and
+   every stored value is checked to fit in a word (excluding WORD_MIN,
+   so that absolute values cannot overflow); if one does not, the
+   routines give up and return ROOTS_OVERFLOW, and the caller should
+   rerun the fmpz version on the same input.
+ */
+
+#define SI_FITS(x) ((x) <= WORD_MAX && (x) >= -WORD_MAX)
+#define SI_SET(r, x) \
+    do { __int128 _x = (x); \
+         if (!SI_FITS(_x)) return ROOTS_OVERFLOW; \
+         (r) = (slong) _x; } while (0)
+#define SI_SGN(x) (((x) > 0) - ((x) < 0))
+
+/* Set *res to f(a); return 0 on overflow. */
+static int _si_poly_evaluate(slong *res, const slong *f, slong n, slong a)
+{
+    __int128 x;
+    slong r = 0;
+    slong i;
+
+    for (i = n - 1; i >= 0; i--)
+    {
+        x = (__int128) r * a + f[i];
+        if (!SI_FITS(x))
+            return 0;
+        r = (slong) x;
+    }
+    *res = r;
+    return 1;
+}
+
+/* Set {q, n-1} to the quotient of {f, n} by x-a, assumed exact;
+   return 0 on overflow. */
+static int _si_poly_div_linear(slong *q, const slong *f, slong n, slong a)
+{
+    __int128 x;
+    slong i;
+
+    q[n - 2] = f[n - 1];
+    for (i = n - 2; i >= 1; i--)
+    {
+        x = (__int128) a * q[i] + f[i];
+        if (!SI_FITS(x))
+            return 0;
+        q[i - 1] = (slong) x;
+    }
+    return 1;
+}
+
+static slong _si_vec_content(const slong *f, slong n)
+{
+    ulong g = 0, u, t;
+    slong i;
+
+    for (i = 0; i < n && g != 1; i++)
+    {
+        u = FLINT_ABS(f[i]);
+        while (u != 0)
+        {
+            t = g % u;
+            g = u;
+            u = t;
+        }
+    }
+    return (slong) g;
+}
+
+/*
+    As _fmpz_poly_all_roots_in_interval, with {w, 3 * n} as scratch space.
+ */
+int _si_poly_all_roots_in_interval(const slong *poly, slong n,
+                                   slong a, slong b, slong *w)
+{
+    slong *f0 = w + 0 * n;
+    slong *f1 = w + 1 * n;
+    slong *f2 = w + 2 * n;
+    slong val0_a, val0_b, val1_a, val1_b, c, d, t1, t2, l0, l1;
+    slong *t;
+
+    int sgn0_a;
+    int sgn0_b;
+    slong i;
+
+    for (i = 0; i < n; i++)
+        f0[i] = poly[i];
+    if (!_si_poly_evaluate(&val0_a, f0, n, a))
+        return ROOTS_OVERFLOW;
+
+    /* Remove all factors of x-a */
+    while (val0_a == 0)
+    {
+        if (!_si_poly_div_linear(f1, f0, n, a))
+            return ROOTS_OVERFLOW;
+        SWAP(f0, f1);
+        n--;
+        if (!_si_poly_evaluate(&val0_a, f0, n, a))
+            return ROOTS_OVERFLOW;
+    }
+
+    if (!_si_poly_evaluate(&val0_b, f0, n, b))
+        return ROOTS_OVERFLOW;
+
+    /* Remove all factors of x-b, updating val0_a */
+    SI_SET(c, (__int128) a - b);
+    while (val0_b == 0)
+    {
+        if (!_si_poly_div_linear(f1, f0, n, b))
+            return ROOTS_OVERFLOW;
+        SWAP(f0, f1);
+        n--;
+        val0_a /= c;
+        if (!_si_poly_evaluate(&val0_b, f0, n, b))
+            return ROOTS_OVERFLOW;
+    }
+
+    if (n == 1)
+        return 1;
+
+    for (i = 1; i < n; i++)
+        SI_SET(f1[i - 1], (__int128) i * f0[i]);
+    n--;
+    if (!_si_poly_evaluate(&val1_a, f1, n, a) ||
+        !_si_poly_evaluate(&val1_b, f1, n, b))
+        return ROOTS_OVERFLOW;
+
+    sgn0_a = SI_SGN(val0_a);
+    sgn0_b = SI_SGN(val0_b);
+
+    for ( ; ; )
+    {
+        /* Invariant:  n = len(f1) = len(f0) - 1 */
+
+        /* If we miss any one sign change, we cannot have enough */
+        sgn0_a = -sgn0_a;
+        if (SI_SGN(val1_a) != sgn0_a || SI_SGN(val1_b) != sgn0_b)
+            return 0;
+
+        /* Pseudoremainder, as in the fmpz version */
+        l0 = f0[n];
+        l1 = f1[n - 1];
+        SI_SET(f2[0], - (__int128) l1 * f0[0]);
+        for (i = 1; i < n; i++)
+            SI_SET(f2[i], (__int128) l0 * f1[i - 1] - (__int128) l1 * f0[i]);
+
+        c = -f2[n - 1];
+        for (i = 0; i < n - 1; i++)
+            SI_SET(f2[i], (__int128) l1 * f2[i] + (__int128) c * f1[i]);
+
+        for (i = 0; i < n - 1 && f2[i] == 0; i++) ;
+        if (i == n - 1)
+            return 1;
+
+        n--;
+
+        /* Cannot have enough sign changes if the degree drops more than 1 */
+        if (f2[n - 1] == 0)
+            return 0;
+
+        d = _si_vec_content(f2, n);
+
+        /* val2_a = (c*val1_a + lead1*(lead0*val1_a*a - lead1*val0_a)) // d */
+        SI_SET(t1, (__int128) val1_a * a);
+        SI_SET(t2, (__int128) l0 * t1 - (__int128) l1 * val0_a);
+        SI_SET(t1, (__int128) c * val1_a + (__int128) l1 * t2);
+        val0_a = val1_a;
+        val1_a = t1 / d;
+
+        /* val2_b = (c*val1_b + lead1*(lead0*val1_b*b - lead1*val0_b)) // d */
+        SI_SET(t1, (__int128) val1_b * b);
+        SI_SET(t2, (__int128) l0 * t1 - (__int128) l1 * val0_b);
+        SI_SET(t1, (__int128) c * val1_b + (__int128) l1 * t2);
+        val0_b = val1_b;
+        val1_b = t1 / d;
+
+        /* Rotate the polynomials */
+        for (i = 0; i < n; i++)
+            f0[i] = f2[i] / d;
+        SWAP(f0, f1);
+    }
+
+    return 1;
+}
+
+/*
+    As _fmpz_poly_all_roots_real, with {w, 3 * n} as scratch space.
+ */
+int _si_poly_all_roots_real(const slong *poly, slong n, slong *w)
+{
+    slong *f0 = w + 0 * n;
+    slong *f1 = w + 1 * n;
+    slong *f2 = w + 2 * n;
+    slong c, d, l0, l1;
+    slong *t;
+
+    int sgn0_l;
+    int sgn1_l;
+    slong i;
+    slong j;
+    slong n0 = n-1;
+
+    if (n == 1)
+        return 1;
+
+    for (i = 0; i < n; i++)
+        f0[i] = poly[i];
+    for (i = 1; i < n; i++)
+        SI_SET(f1[i - 1], (__int128) i * f0[i]);
+    n--;
+    sgn0_l = SI_SGN(f0[n]);
+
+    for ( ; ; )
+    {
+        /* Invariant:  n = len(f0) - 1, len(f1) <= n */
+
+        l0 = f0[n];
+        l1 = f1[n - 1];
+        sgn1_l = SI_SGN(l1);
+        /* If we miss any one sign change, we cannot have enough */
+        if (sgn1_l == 0) return(0);
+        if (sgn1_l != sgn0_l) {
+            j = 2*n - n0+1;
+            if (j>0) return(-j); /* Independent of terms of degree <j */
+            return 0;
+        }
+
+        /* Pseudoremainder, as in the fmpz version */
+        SI_SET(f2[0], - (__int128) l1 * f0[0]);
+        for (i = 1; i < n; i++)
+            SI_SET(f2[i], (__int128) l0 * f1[i - 1] - (__int128) l1 * f0[i]);
+        c = f2[n - 1];
+        for (i = 0; i < n - 1; i++)
+            SI_SET(f2[i], (__int128) l1 * f2[i] - (__int128) c * f1[i]);
+
+        for (i = 0; i < n - 1 && f2[i] == 0; i++) ;
+        if (i == n - 1)
+            return 1;
+
+        n--;
+
+        d = _si_vec_content(f2, n);
+        for (i = 0; i < n; i++)
+            f0[i] = f2[i] / d;
+
+        /* Rotate the polynomials */
+        SWAP(f0, f1);
+    }
+
+    return 1;
+}
+
+/*
+    Replace {a, lena} by lc(b)^(lena - lenb + 1) * a modulo {b, lenb},
+    leaving the pseudo-remainder in {a, lenb - 1}; assumes lena >= lenb >= 1.
+ */
+void _fmpz_poly_prem_inplace(fmpz *a, slong lena, const fmpz *b, slong lenb)
+{
+    slong i;
+
+    for (i = lena - 1; i >= lenb - 1; i--)
+    {
+        _fmpz_vec_scalar_mul_fmpz(a, a, i, b + lenb - 1);
+        _fmpz_vec_scalar_submul_fmpz(a + i - lenb + 1, b, lenb - 1, a + i);
+        fmpz_zero(a + i);
+    }
+}
+
+/*
+    Return the Cauchy index of {r, m} / {p, n} over the real line, that is,
+    the number of sign changes at -infinity minus the number at +infinity
+    in the signed remainder sequence p, r, -rem(p, r), ...
+    By Sturm's theorem, if r = p' this is the number of distinct real roots
+    of p; if r = p' * q mod p, it is the sum of the signs of q at these roots.
+
+    Assumes that p[n-1] != 0 and m < n; {w, 2 * n + 1} is scratch space.
+ */
+slong _fmpz_poly_cauchy_index(const fmpz *p, slong n, const fmpz *r, slong m,
+                              fmpz *w)
+{
+    fmpz *f0 = w;
+    fmpz *f1 = w + n;
+    fmpz *c  = w + 2 * n;
+    fmpz *t;
+    slong v_pos = 0, v_neg = 0, e;
+    int s0_pos, s0_neg, s1_pos, s1_neg;
+
+    _fmpz_vec_set(f0, p, n);
+    _fmpz_vec_set(f1, r, m);
+    while (m > 0 && fmpz_is_zero(f1 + m - 1))
+        m--;
+
+    s0_pos = fmpz_sgn(f0 + n - 1);
+    s0_neg = (n % 2) ? s0_pos : -s0_pos;
+    while (m > 0)
+    {
+        s1_pos = fmpz_sgn(f1 + m - 1);
+        s1_neg = (m % 2) ? s1_pos : -s1_pos;
+        if (s1_pos != s0_pos) v_pos++;
+        if (s1_neg != s0_neg) v_neg++;
+
+        /* f0 := -rem(f0, f1), up to a positive factor */
+        e = n - m + 1;
+        _fmpz_poly_prem_inplace(f0, n, f1, m);
+        if (s1_pos > 0 || e % 2 == 0)
+            _fmpz_vec_neg(f0, f0, m - 1);
+        n = m - 1;
+        while (n > 0 && fmpz_is_zero(f0 + n - 1))
+            n--;
+        if (n > 0)
+        {
+            _fmpz_vec_content(c, f0, n);
+            _fmpz_vec_scalar_divexact_fmpz(f0, f0, n, c);
+        }
+
+        SWAP(f0, f1);
+        e = n; n = m; m = e;
+        s0_pos = s1_pos;
+        s0_neg = s1_neg;
+    }
+
+    return v_neg - v_pos;
+}
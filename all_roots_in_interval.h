@@ -7,5 +7,17 @@ int _fmpz_poly_all_roots_in_interval(fmpz *poly, slong n,
                                      fmpz const * a, fmpz const * b, fmpz *w);
 int _fmpz_poly_all_roots_real(fmpz *poly, slong n, fmpz *w);
 
+/* Returned by the word-size versions if an intermediate result
+   does not fit in a word. */
+#define ROOTS_OVERFLOW 2
+
+int _si_poly_all_roots_in_interval(const slong *poly, slong n,
+                                   slong a, slong b, slong *w);
+int _si_poly_all_roots_real(const slong *poly, slong n, slong *w);
+
+void _fmpz_poly_prem_inplace(fmpz *a, slong lena, const fmpz *b, slong lenb);
+slong _fmpz_poly_cauchy_index(const fmpz *p, slong n, const fmpz *r, slong m,
+                              fmpz *w);
+
 #endif
 
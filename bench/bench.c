@@ -0,0 +1,803 @@
+/* Benchmark and regression harness for the search engine, without Sage.
+
+   Usage: bench [-b baseline] [-w baseline] [-t threads] [-r repeat]
+                [-f pattern] [-m] cases...
+
+   Each line of a cases file (other than blank lines and comments,
+   starting with #) describes a call to roots_on_unit_circle:
+
+     name modulus n answer_count filter P0
+
+   where answer_count = 0 means all solutions, filter is a combination
+   of PS_FILTER_NO_ROOTS_OF_UNITY and PS_FILTER_EJ, and P0 is the list
+   of coefficients of P0, starting with the constant term.
+
+   One line of JSON is printed per case, with the number of solutions,
+   the node count, the wall time (the best of the repeats) and the number
+   of nodes per second, then a summary line. Only the cases whose names
+   contain the pattern given by -f are run. With -b, the solution and
+   node counts are compared with those in the baseline file (lines of
+   the form "name solutions count"), and the exit status is 1 if any of
+   them differs. With -w, such a baseline file is written.
+
+   With -m, each case is instead searched once in full with next_pol,
+   and then in each of the other modes of the search engine, which must
+   give the same solutions (in the same order, where the mode keeps it)
+   and node count: a checkpoint written by a pool and resumed in a new
+   one, the binary solution file, a manifest searched in three parts and
+   merged, a coordinator with one worker over TCP on the loopback
+   interface, a refinement session (which must only give the same
+   solutions), a count-only search (which only gives the numbers of
+   solutions and nodes), and a search in centre-first order (which must
+   only give the same solutions). With a fixed seed, the estimator
+   must give the same results twice, and the sampler the same samples on
+   one and three threads, all among the solutions. One line of JSON is
+   printed per case and mode, and the exit status is 1 if any of them
+   fails. Temporary files go in the current directory.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <flint.h>
+#include <fmpz_poly.h>
+
+#include "power_sums.h"
+#include "work_stealing.h"
+#include "checkpoint.h"
+#include "solution_file.h"
+#include "shard.h"
+#include "remote.h"
+#include "session.h"
+
+#define MAX_LINE 65536
+
+typedef struct bench_case {
+  char name[256];
+  int modulus, n, answer_count, filter;
+  fmpz_poly_t P0;
+} bench_case_t;
+
+/* The parameters of the search, as computed by asymmetrize and
+   roots_on_unit_circle in prescribed_roots.sage. */
+typedef struct bench_search {
+  int d, lead, sign, q, cofactor;
+  int *Q0, *modlist;
+} bench_search_t;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec + 1e-9*ts.tv_nsec);
+}
+
+/* Read the next case from f. Return 1 on success, 0 at the end of the
+   file, and -1 on a malformed line. */
+static int read_case(FILE *f, bench_case_t *c) {
+  static char line[MAX_LINE];
+  char *s, *e;
+  slong i;
+  long v;
+
+  while (fgets(line, MAX_LINE, f) != NULL) {
+    s = line;
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s == '#' || *s == '\n' || *s == '\0') continue;
+    if (sscanf(s, "%255s %d %d %d %d", c->name, &c->modulus, &c->n,
+	       &c->answer_count, &c->filter) != 5) return(-1);
+    for (i=0; i<5; i++) {
+      while (*s == ' ' || *s == '\t') s++;
+      while (*s != ' ' && *s != '\t' && *s != '\0') s++;
+    }
+    fmpz_poly_zero(c->P0);
+    for (i=0; ; i++) {
+      v = strtol(s, &e, 10);
+      if (e == s) break;
+      fmpz_poly_set_coeff_si(c->P0, i, v);
+      s = e;
+    }
+    return(fmpz_poly_degree(c->P0) < 1 ? -1 : 1);
+  }
+  return(0);
+}
+
+/* Set Q to Q/(1 - c x), returning 0 if the division is not exact. */
+static int divide_linear(fmpz_poly_t Q, slong c) {
+  fmpz_poly_t R;
+  fmpz_t t;
+  slong i, len = fmpz_poly_length(Q);
+  int r;
+
+  fmpz_poly_init(R);
+  fmpz_init(t);
+  fmpz_poly_set(R, Q);
+  for (i=1; i<len; i++) {
+    fmpz_mul_si(t, R->coeffs+i-1, c);
+    fmpz_add(R->coeffs+i, R->coeffs+i, t);
+  }
+  r = fmpz_is_zero(R->coeffs+len-1);
+  fmpz_poly_truncate(R, len-1);
+  fmpz_poly_swap(Q, R);
+  fmpz_poly_clear(R);
+  fmpz_clear(t);
+  return(r);
+}
+
+/* Compute the parameters of the search from P0, as in asymmetrize
+   (restricted to integral q). Return 0 if P0 is not self-inversive. */
+static int asymmetrize(bench_search_t *s, const bench_case_t *c) {
+  fmpz_poly_t Q, T, B;
+  fmpz_t r, t;
+  slong i, j, m, D = fmpz_poly_degree(c->P0);
+  int ok = 1, sg = 0;
+
+  s->Q0 = NULL;
+  fmpz_poly_init(Q);
+  fmpz_poly_init(T);
+  fmpz_poly_init(B);
+  fmpz_init(r);
+  fmpz_init(t);
+
+  /* q = |P[D]/P[0]|^(2/D), and P[i] = sg P[D-i] q^(i-D/2). */
+  if (fmpz_is_zero(c->P0->coeffs) ||
+      !fmpz_divisible(c->P0->coeffs+D, c->P0->coeffs)) ok = 0;
+  if (ok) {
+    fmpz_divexact(r, c->P0->coeffs+D, c->P0->coeffs);
+    sg = fmpz_sgn(r);
+    fmpz_mul(r, r, r);
+    fmpz_root(t, r, D);
+    s->q = fmpz_get_si(t);
+    fmpz_pow_ui(t, t, D);
+    if (!fmpz_equal(t, r)) ok = 0;
+  }
+  for (i=0; ok && 2*i<D; i++) {
+    /* P[D-i] = sg q^(D/2-i) P[i] */
+    fmpz_set_si(t, s->q);
+    fmpz_pow_ui(t, t, D-2*i);
+    fmpz_mul(t, t, c->P0->coeffs+i);
+    fmpz_mul(t, t, c->P0->coeffs+i);
+    fmpz_mul(r, c->P0->coeffs+D-i, c->P0->coeffs+D-i);
+    if (!fmpz_equal(t, r) ||
+	fmpz_sgn(c->P0->coeffs+i)*sg != fmpz_sgn(c->P0->coeffs+D-i))
+      ok = 0;
+  }
+
+  /* Remove the cofactor, numbered as in ps_cofactor. */
+  fmpz_poly_set(Q, c->P0);
+  s->cofactor = 0;
+  if (ok && sg < 0) {
+    s->cofactor = 2;
+    ok = divide_linear(Q, s->q);
+  }
+  if (ok && fmpz_poly_degree(Q)%2 == 1) {
+    s->cofactor = (s->cofactor == 2) ? 3 : 1;
+    ok = divide_linear(Q, -s->q);
+  }
+
+  /* Peel off the terms c_i (1+qx^2)^i x^(m-i) of Q. */
+  if (ok) {
+    m = fmpz_poly_degree(Q)/2;
+    s->d = m;
+    s->Q0 = (int *)malloc((m+1)*sizeof(int));
+    fmpz_poly_set_coeff_si(B, 0, 1);
+    fmpz_poly_set_coeff_si(B, 2, s->q);
+    for (i=m; i>=0; i--) {
+      fmpz_poly_get_coeff_fmpz(t, Q, 0);
+      if (!fmpz_fits_si(t)) ok = 0;
+      s->Q0[i] = fmpz_get_si(t);
+      fmpz_poly_pow(T, B, i);
+      fmpz_poly_scalar_mul_fmpz(T, T, t);
+      fmpz_poly_sub(Q, Q, T);
+      fmpz_poly_shift_right(Q, Q, 1);
+    }
+    if (!fmpz_poly_is_zero(Q)) ok = 0;
+  }
+
+  if (ok) {
+    /* Normalize the sign of the leading coefficient, and set up the
+       moduli as in roots_on_unit_circle. */
+    s->sign = 1;
+    if (s->Q0[s->d] < 0) {
+      s->sign = -1;
+      for (i=0; i<=s->d; i++) s->Q0[i] = -s->Q0[i];
+    }
+    s->lead = s->Q0[s->d];
+    s->modlist = (int *)malloc((s->d+1)*sizeof(int));
+    for (j=0; j<=s->d; j++)
+      s->modlist[j] = (s->d-j < c->n) ? 0 : c->modulus;
+  } else free(s->Q0);
+
+  fmpz_poly_clear(Q);
+  fmpz_poly_clear(T);
+  fmpz_poly_clear(B);
+  fmpz_clear(r);
+  fmpz_clear(t);
+  return(ok);
+}
+
+/* Run one search; set *solutions and *count. */
+static void run_search(const bench_search_t *s, const bench_case_t *c,
+		       int threads, long *solutions, long *count) {
+  ps_static_data_t *st_data;
+  ps_dynamic_data_t *dy_data;
+  ps_pool_t *pool;
+  int t, *Q;
+
+  st_data = ps_static_init(s->d, s->lead, s->sign, s->q, s->cofactor,
+			   s->modlist, -1, -1, NULL, NULL);
+  ps_static_set_filter(st_data, c->filter);
+  dy_data = ps_dynamic_init(s->d, s->Q0);
+  *solutions = 0;
+  if (threads > 0) {
+    Q = (int *)malloc((2*s->d+3)*sizeof(int));
+    pool = ps_pool_init_limit(st_data, &dy_data, 1, threads, NULL,
+			      c->answer_count ? c->answer_count : -1);
+    while ((t = ps_pool_next_solution(pool, Q)) != 0)
+      if (t > 0) *solutions += 1;
+    *count = ps_pool_count(pool);
+    ps_pool_clear(pool);
+    free(Q);
+  } else {
+    while (next_pol(st_data, dy_data) > 0) {
+      *solutions += 1;
+      if (*solutions == c->answer_count) break;
+    }
+    *count = extract_count(dy_data);
+  }
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+}
+
+/* The solutions of a search, one per line, as written by weilsearch,
+   with the node count. */
+typedef struct bench_output {
+  FILE *f;
+  char *buf;
+  size_t len;
+  long count, solutions;
+} bench_output_t;
+
+/* What output_matches compares, besides the number of solutions. */
+#define MATCH_LINES 1 /* the solutions, in any order */
+#define MATCH_ORDER 2 /* the solutions, in the same order */
+#define MATCH_COUNT 4 /* the node count */
+
+static void output_open(bench_output_t *o) {
+  o->buf = NULL;
+  o->len = 0;
+  o->f = open_memstream(&o->buf, &o->len);
+  o->count = o->solutions = 0;
+}
+
+/* Close o->f, leaving the text in o->buf. */
+static void output_close(bench_output_t *o) {
+  if (o->f != NULL) fclose(o->f);
+  o->f = NULL;
+}
+
+static void output_clear(bench_output_t *o) {
+  output_close(o);
+  free(o->buf);
+}
+
+static void print_pol(FILE *f, const int *Q, int len) {
+  int i;
+  fprintf(f, "[");
+  for (i=0; i<len; i++)
+    fprintf(f, i ? ", %d" : "%d", Q[i]);
+  fprintf(f, "]\n");
+}
+
+static int cmp_lines(const void *a, const void *b) {
+  return(strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+/* Return the lines of buf (which is modified), sorted, setting *num. */
+static char **sorted_lines(char *buf, long *num) {
+  char **lines = NULL, *s;
+  long size = 0;
+
+  *num = 0;
+  for (s = strtok(buf, "\n"); s != NULL; s = strtok(NULL, "\n")) {
+    if (*num == size) {
+      size = 2*size + 64;
+      lines = (char **)realloc(lines, size*sizeof(char *));
+    }
+    lines[(*num)++] = s;
+  }
+  qsort(lines, *num, sizeof(char *), cmp_lines);
+  return(lines);
+}
+
+/* Whether o has as many solutions as ref, and what how asks for in
+   common with it. */
+static int output_matches(bench_output_t *ref, bench_output_t *o, int how) {
+  char *b1, *b2, **l1, **l2;
+  long n1, n2, i;
+  int r;
+
+  if (o->solutions != ref->solutions ||
+      ((how & MATCH_COUNT) && o->count != ref->count)) return(0);
+  if (how & MATCH_ORDER)
+    return(o->len == ref->len && memcmp(o->buf, ref->buf, o->len) == 0);
+  if (!(how & MATCH_LINES)) return(1);
+  b1 = strndup(ref->buf, ref->len);
+  b2 = strndup(o->buf, o->len);
+  l1 = sorted_lines(b1, &n1);
+  l2 = sorted_lines(b2, &n2);
+  r = (n1 == n2);
+  for (i=0; r && i<n1; i++) r = (strcmp(l1[i], l2[i]) == 0);
+  free(l1);
+  free(l2);
+  free(b1);
+  free(b2);
+  return(r);
+}
+
+static ps_static_data_t *bench_static(const bench_search_t *s, int filter) {
+  ps_static_data_t *st_data;
+
+  st_data = ps_static_init(s->d, s->lead, s->sign, s->q, s->cofactor,
+			   s->modlist, -1, -1, NULL, NULL);
+  ps_static_set_filter(st_data, filter);
+  return(st_data);
+}
+
+/* The whole search with next_pol, visiting the values of the
+   coefficients in the given order (see ps_static_set_order). In
+   increasing order, this is the run against which the modes are
+   checked. */
+static void mode_plain(const bench_search_t *s, int filter, int order,
+		       bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  int *Q = (int *)malloc((2*s->d+3)*sizeof(int));
+
+  ps_static_set_order(st_data, order);
+  output_open(o);
+  while (next_pol(st_data, dy_data) > 0) {
+    extract_symmetrized_pol(Q, dy_data);
+    print_pol(o->f, Q, 2*s->d+3);
+    o->solutions += 1;
+  }
+  o->count = extract_count(dy_data);
+  output_close(o);
+  free(Q);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+}
+
+/* Only count the solutions (see ps_static_set_count_only). */
+static int mode_count(const bench_search_t *s, int filter,
+		      bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  int r;
+
+  ps_static_set_count_only(st_data, 1);
+  r = (next_pol(st_data, dy_data) == 0);
+  o->solutions = extract_solutions(dy_data);
+  o->count = extract_count(dy_data);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  return(r);
+}
+
+/* Take the solutions of pool, until it is done or (unless stop is -1)
+   until o has stop of them. */
+static void take_solutions(ps_pool_t *pool, int len, bench_output_t *o,
+			   long stop) {
+  int t, *Q = (int *)malloc(len*sizeof(int));
+
+  while (o->solutions != stop && (t = ps_pool_next_solution(pool, Q)) != 0)
+    if (t > 0) {
+      print_pol(o->f, Q, len);
+      o->solutions += 1;
+    }
+  free(Q);
+}
+
+/* Search on two threads until half of the solutions are found, write a
+   checkpoint and drop the pool, then resume from the checkpoint in a new
+   pool, as weilsearch -k and -r do. */
+static int mode_checkpoint(const bench_search_t *s, int filter,
+			   bench_output_t *ref, const char *tmp,
+			   bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  ps_checkpoint_t *ck;
+  ps_pool_t *pool;
+  int i, r, len = 2*s->d+3, *Q = (int *)malloc(len*sizeof(int));
+
+  pool = ps_pool_init(st_data, &dy_data, 1, 2);
+  take_solutions(pool, len, o, ref->solutions/2);
+  ps_pool_pause(pool);
+  while (ps_pool_next_solution(pool, Q) > 0) {
+    print_pol(o->f, Q, len);
+    o->solutions += 1;
+  }
+  r = ps_pool_checkpoint(pool, tmp, 0, o->solutions, -1);
+  ps_pool_clear(pool);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  free(Q);
+  ck = r ? ps_checkpoint_read(tmp) : NULL;
+  unlink(tmp);
+  if (ck == NULL) return(0);
+
+  st_data = ps_static_init(ck->d, ck->lead, ck->sign, ck->q, ck->cofactor,
+			   ck->modlist, ck->verbosity, ck->node_count,
+			   ck->point_count, ck->newton);
+  ps_static_set_filter(st_data, filter);
+  for (i=0; i<ck->num_states; i++)
+    ps_dynamic_restore(st_data, ck->states[i]);
+  r = (ck->solutions == o->solutions);
+  pool = ps_pool_init(st_data, ck->states, ck->num_states, 2);
+  take_solutions(pool, len, o, -1);
+  o->count = ck->count + ps_pool_count(pool);
+  ps_pool_clear(pool);
+  ps_checkpoint_clear(ck);
+  ps_static_clear(st_data);
+  return(r);
+}
+
+/* Write the solutions to a binary solution file on two threads, then
+   read them back. */
+static int mode_binary(const bench_search_t *s, int filter, const char *tmp,
+		       bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  ps_sink_t *sink;
+  ps_pool_t *pool;
+  long written;
+  int r;
+
+  sink = ps_sink_open(tmp, st_data, -1);
+  r = (sink != NULL);
+  if (r) {
+    pool = ps_pool_init_sink(st_data, &dy_data, 1, 2, sink);
+    take_solutions(pool, 2*s->d+3, o, -1);
+    o->count = ps_pool_count(pool);
+    ps_pool_clear(pool);
+    written = ps_sink_count(sink);
+    r = ps_sink_close(sink) && o->solutions == 0;
+    o->solutions = ps_solfile_to_text(tmp, o->f);
+    r = r && o->solutions == written;
+  }
+  unlink(tmp);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  return(r);
+}
+
+/* Write a manifest at depth 2, search it in three parts, and merge the
+   results files. */
+static int mode_shard(const bench_search_t *s, int filter, const char *tmp,
+		      bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  ps_manifest_t *m = NULL;
+  char names[3][256];
+  const char *parts[3];
+  long count, solutions;
+  FILE *f;
+  int i, r;
+
+  r = (ps_manifest_write(tmp, st_data, dy_data, s->d < 2 ? s->d : 2, 16) >= 0);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  if (r) m = ps_manifest_read(tmp);
+  r = (m != NULL);
+  for (i=0; i<3; i++) {
+    snprintf(names[i], sizeof(names[i]), "%s.%d", tmp, i);
+    parts[i] = names[i];
+    if (!r) continue;
+    f = fopen(names[i], "w");
+    r = (f != NULL);
+    if (r) {
+      r = ps_shard_run(m, i, 3, f, 1, &count, &solutions);
+      r = (fclose(f) == 0) && r;
+    }
+  }
+  if (r)
+    r = ps_shard_merge(m, parts, 3, o->f, &o->count, &o->solutions);
+  for (i=0; i<3; i++) unlink(names[i]);
+  unlink(tmp);
+  if (m != NULL) ps_manifest_clear(m);
+  return(r);
+}
+
+/* Work for the coordinator at arg (ps_remote_worker_run waits for it to
+   come up). */
+static void *remote_worker(void *arg) {
+  ps_remote_worker_run((const char *)arg);
+  return(NULL);
+}
+
+/* Search with a coordinator and one worker, over TCP on the loopback
+   interface, at a port depending on the process id. */
+static int mode_remote(const bench_search_t *s, int filter,
+		       bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  pthread_t worker;
+  char address[64];
+  int r;
+
+  snprintf(address, sizeof(address), "127.0.0.1:%d", 20000 + getpid()%20000);
+  pthread_create(&worker, NULL, remote_worker, address);
+  r = ps_coordinator_run(address, st_data, &dy_data, 1, o->f, &o->count,
+			 &o->solutions);
+  pthread_join(worker, NULL);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  return(r);
+}
+
+/* The samples of ps_sample with a fixed seed, as lines of o. */
+static long sample_run(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		       int num_threads, double *weights, bench_output_t *o) {
+  int len = 2*st_data->d+3, *Q = (int *)malloc(16*len*sizeof(int));
+  ps_sample_stats_t res;
+  long i, num;
+
+  num = ps_sample(st_data, dy_data, 16, 1, 0, 0.0, 1000, num_threads, Q,
+		  weights, &res);
+  for (i=0; i<num; i++) print_pol(o->f, Q + i*len, len);
+  free(Q);
+  return(num);
+}
+
+/* Run the estimator twice and the sampler on one and three threads with
+   a fixed seed: the results must not change, and the samples must be
+   among the solutions of ref. */
+static int mode_sample(const bench_search_t *s, int filter,
+		       bench_output_t *ref) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  ps_estimate_t e1, e2;
+  bench_output_t o1, o2;
+  double w1[16], w2[16];
+  char *b, *line, **lines;
+  long n, num1, num2;
+  int r;
+
+  ps_estimate(st_data, dy_data, 100, 1, 0, &e1);
+  ps_estimate(st_data, dy_data, 100, 1, 0, &e2);
+  r = (memcmp(&e1, &e2, sizeof(ps_estimate_t)) == 0) &&
+    (ref->solutions > 0 || e1.solutions == 0.0);
+
+  output_open(&o1);
+  output_open(&o2);
+  num1 = sample_run(st_data, dy_data, 1, w1, &o1);
+  num2 = sample_run(st_data, dy_data, 3, w2, &o2);
+  output_close(&o1);
+  output_close(&o2);
+  r = r && num1 == num2 && memcmp(w1, w2, num1*sizeof(double)) == 0 &&
+    o1.len == o2.len && memcmp(o1.buf, o2.buf, o1.len) == 0 &&
+    (ref->solutions > 0 || num1 == 0);
+
+  b = strndup(ref->buf, ref->len);
+  lines = sorted_lines(b, &n);
+  for (line = strtok(o1.buf, "\n"); r && line != NULL;
+       line = strtok(NULL, "\n"))
+    r = (bsearch(&line, lines, n, sizeof(char *), cmp_lines) != NULL);
+  free(lines);
+  free(b);
+  output_clear(&o1);
+  output_clear(&o2);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  return(r);
+}
+
+static void session_emit(void *arg, ps_dynamic_data_t *dy_data) {
+  bench_output_t *o = (bench_output_t *)arg;
+  int *Q = (int *)malloc((2*dy_data->d+3)*sizeof(int));
+
+  extract_symmetrized_pol(Q, dy_data);
+  print_pol(o->f, Q, 2*dy_data->d+3);
+  free(Q);
+}
+
+/* One search of a refinement session; return as ps_session_search. */
+static int session_run(ps_session_t *session, const bench_search_t *s,
+		       int filter, bench_output_t *o) {
+  ps_static_data_t *st_data = bench_static(s, filter);
+  ps_dynamic_data_t *dy_data = ps_dynamic_init(s->d, s->Q0);
+  int r;
+
+  output_open(o);
+  r = ps_session_search(session, st_data, dy_data, session_emit, o,
+			&o->count, &o->solutions);
+  output_close(o);
+  ps_dynamic_clear(dy_data);
+  ps_static_clear(st_data);
+  return(r);
+}
+
+/* Search without a filter in a session of depth 2, then refine with the
+   filter of the case: the refined search only visits part of the tree,
+   so only its solutions must match those of ref. */
+static int mode_session(const bench_search_t *s, int filter,
+			bench_output_t *ref) {
+  ps_session_t *session = ps_session_init(2);
+  bench_output_t o;
+  int r;
+
+  r = (session_run(session, s, 0, &o) == 0);
+  if (filter == 0) r = r && output_matches(ref, &o, MATCH_ORDER|MATCH_COUNT);
+  output_clear(&o);
+  r = (session_run(session, s, filter, &o) == 1) && r &&
+    output_matches(ref, &o, MATCH_ORDER);
+  output_clear(&o);
+  ps_session_clear(session);
+  return(r);
+}
+
+/* Check each mode of the search against a plain run of the case; print
+   the results and return the number of failures. */
+static int check_modes(const bench_search_t *s, const bench_case_t *c) {
+  static const char *modes[] = {"checkpoint", "binary", "shard", "remote",
+				"sample", "session", "count", "center"};
+  bench_output_t ref, o;
+  char tmp[64];
+  int i, r, how, failures = 0;
+
+  mode_plain(s, c->filter, PS_ORDER_LINEAR, &ref);
+  for (i=0; i<(int)(sizeof(modes)/sizeof(modes[0])); i++) {
+    snprintf(tmp, sizeof(tmp), "bench-%s.%d", modes[i], (int)getpid());
+    output_open(&o);
+    how = MATCH_LINES|MATCH_COUNT;
+    switch (i) {
+    case 0: r = mode_checkpoint(s, c->filter, &ref, tmp, &o); break;
+    case 1: r = mode_binary(s, c->filter, tmp, &o); break;
+    case 2:
+      r = mode_shard(s, c->filter, tmp, &o);
+      how = MATCH_ORDER|MATCH_COUNT;
+      break;
+    case 3: r = mode_remote(s, c->filter, &o); break;
+    case 4: r = mode_sample(s, c->filter, &ref); how = -1; break;
+    case 5: r = mode_session(s, c->filter, &ref); how = -1; break;
+    case 6:
+      r = mode_count(s, c->filter, &o);
+      how = MATCH_COUNT;
+      break;
+    default:
+      /* The node count can differ (see ps_static_set_order). */
+      output_clear(&o);
+      mode_plain(s, c->filter, PS_ORDER_CENTER, &o);
+      r = 1;
+      how = MATCH_LINES;
+    }
+    output_close(&o);
+    if (how != -1) r = r && output_matches(&ref, &o, how);
+    output_clear(&o);
+    printf("{\"case\": \"%s\", \"mode\": \"%s\", \"solutions\": %ld, "
+	   "\"count\": %ld, \"status\": \"%s\"}\n", c->name, modes[i],
+	   ref.solutions, ref.count, r ? "ok" : "mismatch");
+    fflush(stdout);
+    failures += !r;
+  }
+  output_clear(&ref);
+  return(failures);
+}
+
+/* Look up name in the baseline file; return 1 if found. */
+static int baseline_lookup(const char *filename, const char *name,
+			   long *solutions, long *count) {
+  FILE *f;
+  char line[1024], name2[256];
+  int r = 0;
+
+  f = fopen(filename, "r");
+  if (f == NULL) return(0);
+  while (!r && fgets(line, sizeof(line), f) != NULL)
+    if (sscanf(line, "%255s %ld %ld", name2, solutions, count) == 3 &&
+	strcmp(name, name2) == 0) r = 1;
+  fclose(f);
+  return(r);
+}
+
+int main(int argc, char **argv) {
+  const char *baseline = NULL, *pattern = NULL;
+  FILE *f, *wf = NULL;
+  bench_case_t c;
+  bench_search_t s;
+  long solutions, count, solutions0, count0;
+  double t0, t1, best, total = 0;
+  int opt, r, i, threads = 0, repeat = 1, failures = 0, cases = 0;
+  int modes = 0;
+  const char *status;
+
+  while ((opt = getopt(argc, argv, "b:w:t:r:f:m")) != -1) {
+    switch (opt) {
+    case 'b': baseline = optarg; break;
+    case 'w':
+      wf = fopen(optarg, "w");
+      if (wf == NULL) { perror(optarg); return(2); }
+      break;
+    case 't': threads = atoi(optarg); break;
+    case 'r': repeat = atoi(optarg); break;
+    case 'f': pattern = optarg; break;
+    case 'm': modes = 1; break;
+    default:
+      fprintf(stderr, "usage: %s [-b baseline] [-w baseline] [-t threads] "
+	      "[-r repeat] [-f pattern] [-m] cases...\n", argv[0]);
+      return(2);
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "%s: no cases file given\n", argv[0]);
+    return(2);
+  }
+
+  fmpz_poly_init(c.P0);
+  for (; optind < argc; optind++) {
+    f = fopen(argv[optind], "r");
+    if (f == NULL) { perror(argv[optind]); return(2); }
+    while ((r = read_case(f, &c)) != 0) {
+      if (r < 0) {
+	fprintf(stderr, "%s: malformed line after case %d\n", argv[optind],
+		cases);
+	return(2);
+      }
+      if (pattern != NULL && strstr(c.name, pattern) == NULL) continue;
+      cases++;
+      if (!asymmetrize(&s, &c)) {
+	printf("{\"case\": \"%s\", \"status\": \"invalid\"}\n", c.name);
+	failures++;
+	continue;
+      }
+      if (modes) {
+	failures += check_modes(&s, &c);
+	free(s.Q0);
+	free(s.modlist);
+	continue;
+      }
+
+      best = -1;
+      for (i=0; i<repeat || i<1; i++) {
+	t0 = now();
+	run_search(&s, &c, threads, &solutions, &count);
+	t1 = now() - t0;
+	if (best < 0 || t1 < best) best = t1;
+      }
+      total += best;
+
+      status = "ok";
+      if (baseline != NULL) {
+	if (!baseline_lookup(baseline, c.name, &solutions0, &count0))
+	  status = "new";
+	/* With threads, the node count of a truncated search varies. */
+	else if (solutions != solutions0 ||
+		 ((threads == 0 || c.answer_count == 0) && count != count0)) {
+	  status = "mismatch";
+	  failures++;
+	}
+      }
+      printf("{\"case\": \"%s\", \"d\": %d, \"solutions\": %ld, "
+	     "\"count\": %ld, \"seconds\": %.6f, \"nodes_per_sec\": %.0f, "
+	     "\"status\": \"%s\"", c.name, s.d, solutions, count, best,
+	     best > 0 ? count/best : 0., status);
+      if (baseline != NULL && strcmp(status, "mismatch") == 0)
+	printf(", \"expected_solutions\": %ld, \"expected_count\": %ld",
+	       solutions0, count0);
+      printf("}\n");
+      fflush(stdout);
+      if (wf != NULL) fprintf(wf, "%s %ld %ld\n", c.name, solutions, count);
+      free(s.Q0);
+      free(s.modlist);
+    }
+    fclose(f);
+  }
+  printf("{\"cases\": %d, \"failures\": %d, \"seconds\": %.6f, "
+	 "\"threads\": %d}\n", cases, failures, total, threads);
+  fmpz_poly_clear(c.P0);
+  if (wf != NULL) fclose(wf);
+  return(failures > 0);
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "checkpoint.h"
+
+/* Checkpoint files are plain text:
+
+     root-unitary checkpoint 3
+     d lead sign q cofactor verbosity node_count
+     modlist[0] ... modlist[d]
+     0, or 1 followed by the 6 entries of point_count
+     0, or 1 followed by the 2*d+1 entries of newton
+     count solutions offset
+     num_states
+   followed by one line per subtree, as written by ps_dynamic_fprint.
+
+   The file is first written under a temporary name and then renamed,
+   so that a crash while writing leaves the previous checkpoint intact.
+   Older files, which lack the point_count line (version 1) or the
+   newton line (versions 1 and 2), can still be read.
+*/
+
+#define CHECKPOINT_MAGIC "root-unitary checkpoint"
+#define CHECKPOINT_VERSION 3
+
+/* Return 1 on success, 0 on failure. */
+int ps_checkpoint_write(const char *filename, ps_static_data_t *st_data,
+			ps_dynamic_data_t **states, int num_states,
+			long count, long solutions, long offset) {
+  FILE *f;
+  char *tmpname;
+  int i, r;
+
+  tmpname = (char *)malloc(strlen(filename)+5);
+  sprintf(tmpname, "%s.tmp", filename);
+  f = fopen(tmpname, "w");
+  if (f == NULL) {
+    free(tmpname);
+    return(0);
+  }
+  fprintf(f, "%s %d\n", CHECKPOINT_MAGIC, CHECKPOINT_VERSION);
+  ps_static_fprint(f, st_data);
+  fprintf(f, "%ld %ld %ld\n%d\n", count, solutions, offset, num_states);
+  for (i=0; i<num_states; i++)
+    ps_dynamic_fprint(f, states[i]);
+  r = (fflush(f) == 0);
+  r = (fclose(f) == 0) && r;
+  if (r) r = (rename(tmpname, filename) == 0);
+  free(tmpname);
+  return(r);
+}
+
+/* Return NULL if the file cannot be read. */
+ps_checkpoint_t *ps_checkpoint_read(const char *filename) {
+  FILE *f;
+  ps_checkpoint_t *ck;
+  char magic[64];
+  int i, version;
+
+  f = fopen(filename, "r");
+  if (f == NULL) return(NULL);
+  ck = (ps_checkpoint_t *)malloc(sizeof(ps_checkpoint_t));
+  ck->modlist = NULL;
+  ck->point_count = NULL;
+  ck->newton = NULL;
+  ck->num_states = 0;
+  ck->states = NULL;
+
+  if (fgets(magic, sizeof(magic), f) == NULL ||
+      strncmp(magic, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)) != 0 ||
+      sscanf(magic + strlen(CHECKPOINT_MAGIC), "%d", &version) != 1 ||
+      version < 1 || version > CHECKPOINT_VERSION ||
+      fscanf(f, "%d %d %d %d %d %d %ld", &ck->d, &ck->lead, &ck->sign,
+	     &ck->q, &ck->cofactor, &ck->verbosity, &ck->node_count) != 7 ||
+      ck->d < 0)
+    goto fail;
+  ck->modlist = (int *)malloc((ck->d+1)*sizeof(int));
+  for (i=0; i<=ck->d; i++)
+    if (fscanf(f, "%d", ck->modlist+i) != 1) goto fail;
+  if (version >= 2) {
+    if (fscanf(f, "%d", &i) != 1) goto fail;
+    if (i) {
+      ck->point_count = (int *)malloc(6*sizeof(int));
+      for (i=0; i<6; i++)
+	if (fscanf(f, "%d", ck->point_count+i) != 1) goto fail;
+    }
+  }
+  if (version >= 3) {
+    if (fscanf(f, "%d", &i) != 1) goto fail;
+    if (i) {
+      ck->newton = (int *)malloc((2*ck->d+1)*sizeof(int));
+      for (i=0; i<=2*ck->d; i++)
+	if (fscanf(f, "%d", ck->newton+i) != 1) goto fail;
+    }
+  }
+  if (fscanf(f, "%ld %ld %ld %d", &ck->count, &ck->solutions, &ck->offset,
+	     &i) != 4 || i < 0)
+    goto fail;
+  ck->states = (ps_dynamic_data_t **)malloc((i+1)*sizeof(ps_dynamic_data_t *));
+  for (ck->num_states=0; ck->num_states<i; ck->num_states++) {
+    ck->states[ck->num_states] = ps_dynamic_fread(f, ck->d);
+    if (ck->states[ck->num_states] == NULL) goto fail;
+  }
+  fclose(f);
+  return(ck);
+
+ fail:
+  fclose(f);
+  ps_checkpoint_clear(ck);
+  return(NULL);
+}
+
+/* Release the checkpoint, including any states still attached to it;
+   callers taking ownership of the states should set num_states to 0. */
+void ps_checkpoint_clear(ps_checkpoint_t *ck) {
+  int i;
+  for (i=0; i<ck->num_states; i++)
+    ps_dynamic_clear(ck->states[i]);
+  free(ck->states);
+  free(ck->modlist);
+  free(ck->point_count);
+  free(ck->newton);
+  free(ck);
+}
+
+static void *ps_ticker_run(void *arg) {
+  ps_ticker_t *ticker = (ps_ticker_t *)arg;
+  struct timeval now;
+  struct timespec deadline;
+  double t;
+
+  pthread_mutex_lock(&ticker->lock);
+  while (!ticker->stop) {
+    gettimeofday(&now, NULL);
+    t = now.tv_sec + now.tv_usec*1e-6 + ticker->interval;
+    deadline.tv_sec = (time_t)t;
+    deadline.tv_nsec = (long)((t - floor(t))*1e9);
+    while (!ticker->stop &&
+	   pthread_cond_timedwait(&ticker->cond, &ticker->lock,
+				  &deadline) != ETIMEDOUT);
+    if (!ticker->stop)
+      __atomic_store_n(ticker->flag, 1, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&ticker->lock);
+  return(NULL);
+}
+
+/* Set *flag every interval seconds, until ps_ticker_clear is called. */
+ps_ticker_t *ps_ticker_init(int *flag, double interval) {
+  ps_ticker_t *ticker;
+
+  ticker = (ps_ticker_t *)malloc(sizeof(ps_ticker_t));
+  pthread_mutex_init(&ticker->lock, NULL);
+  pthread_cond_init(&ticker->cond, NULL);
+  ticker->flag = flag;
+  ticker->interval = interval;
+  ticker->stop = 0;
+  pthread_create(&ticker->thread, NULL, ps_ticker_run, ticker);
+  return(ticker);
+}
+
+void ps_ticker_clear(ps_ticker_t *ticker) {
+  pthread_mutex_lock(&ticker->lock);
+  ticker->stop = 1;
+  pthread_cond_signal(&ticker->cond);
+  pthread_mutex_unlock(&ticker->lock);
+  pthread_join(ticker->thread, NULL);
+  pthread_mutex_destroy(&ticker->lock);
+  pthread_cond_destroy(&ticker->cond);
+  free(ticker);
+}
@@ -0,0 +1,41 @@
+#ifndef CHECKPOINT
+#define CHECKPOINT
+
+#include <pthread.h>
+#include "power_sums.h"
+
+/* Contents of a checkpoint file: the parameters of ps_static_init
+   (with point_count and newton NULL if not set), the number of nodes in
+   subtrees already finished, the number of solutions already emitted 
+   (and the matching position in the output file, or -1), and the 
+   subtrees still to be searched. */
+typedef struct ps_checkpoint {
+  int d, lead, sign, q, cofactor, verbosity;
+  long node_count;
+  int *modlist;
+  int *point_count, *newton;
+  long count, solutions, offset;
+  int num_states;
+  ps_dynamic_data_t **states;
+} ps_checkpoint_t;
+
+/* Sets *flag at regular intervals, to make next_pol return -2. */
+typedef struct ps_ticker {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int *flag;
+  double interval;
+  int stop;
+} ps_ticker_t;
+
+int ps_checkpoint_write(const char *filename, ps_static_data_t *st_data,
+			ps_dynamic_data_t **states, int num_states,
+			long count, long solutions, long offset);
+ps_checkpoint_t *ps_checkpoint_read(const char *filename);
+void ps_checkpoint_clear(ps_checkpoint_t *ck);
+
+ps_ticker_t *ps_ticker_init(int *flag, double interval);
+void ps_ticker_clear(ps_ticker_t *ticker);
+
+#endif
@@ -1,47 +1,50 @@
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
 #include <flint.h>
 #include <fmpz_poly.h>
-#include <fmpq.h>
-#include <fmpq_mat.h>
+#include <fmpz_mat.h>
 #include <arith.h>
 
+#include "power_sums.h"
 #include "all_roots_in_interval.h"
 
-/* Primary data structures.
- */
-
-typedef struct ps_static_data {
-  int d, lead, sign, q, verbosity;
-  long node_count;
-  fmpz_t a, b;
-  fmpz_mat_t binom_mat;
-  fmpz *cofactor;
-  fmpz *modlist;
-  fmpq_mat_t *sum_mats;
-  fmpq_t *f;
-} ps_static_data_t;
-
-typedef struct ps_dynamic_data {
-  int d, n, ascend;
-  long count;
-  fmpq_mat_t sum_col, sum_prod;
-  fmpz *pol, *sympol, *upper;
-
-  /* Scratch space */
-  fmpz *w;
-  int wlen; /* = 4*d+12 */
-  fmpq *w2;
-  int w2len; /* = 5 */
-} ps_dynamic_data_t;
-
-/* Set res to floor(a). */
-void fmpq_floor(fmpz_t res, const fmpq_t a) {
-  fmpz_fdiv_q(res, fmpq_numref(a), fmpq_denref(a));
-};
-
-/* Set res to ceil(a). */
-void fmpq_ceil(fmpz_t res, const fmpq_t a) {
-  fmpz_cdiv_q(res, fmpq_numref(a), fmpq_denref(a));
-};
+/* The coefficients in the Sturm sequence of a polynomial of length k
+   with b-bit coefficients tend to need about k*b bits. When this is at
+   most SI_STURM_BITS, the word-size Sturm routines are tried first. */
+#define SI_STURM_BITS 56
+
+/* Instrumentation: if compiled with -DPS_STATS, each dynamic state keeps
+   the counters in ps_stats_t for every level n. Otherwise these macros
+   expand to nothing (or to the bare statement, for PS_TIMED). */
+#ifdef PS_STATS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PS_CYCLES() ((long)__rdtsc())
+#else
+#include <time.h>
+static long PS_CYCLES() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec*1000000000L + ts.tv_nsec);
+}
+#endif
+#define PS_STAT(dy_data, n, field, x) ((dy_data)->stats[n].field += (x))
+#define PS_STAT_ABORT(dy_data, n, k) do {				\
+    (dy_data)->stats[n].early_abort += 1;				\
+    (dy_data)->stats[n].early_skip[(k) < PS_STATS_SKIP ? (k) :		\
+				   PS_STATS_SKIP-1] += 1;		\
+  } while (0)
+#define PS_TIMED(dy_data, n, field, ...) do {				\
+    long ps_t0 = PS_CYCLES();						\
+    __VA_ARGS__;							\
+    PS_STAT(dy_data, n, field, PS_CYCLES() - ps_t0);			\
+  } while (0)
+#else
+#define PS_STAT(dy_data, n, field, x)
+#define PS_STAT_ABORT(dy_data, n, k)
+#define PS_TIMED(dy_data, n, field, ...) do { __VA_ARGS__; } while (0)
+#endif
 
 void fmpz_sqrt_f(fmpz_t res, const fmpz_t a) {
   fmpz_sqrt(res, a);
@@ -53,148 +56,220 @@ void fmpz_sqrt_c(fmpz_t res, const fmpz_t a) {
   if (!s) fmpz_add_ui(res, res, 1);
 }
 
-/* Set res to floor(a + b sqrt(q)). 
-   For efficiency, we do not assume a and b are canonical;
-   we must thus be careful about signs. */
-void fmpq_floor_quad(fmpz_t res, const fmpq_t a,
-		     const fmpq_t b, int q) {
-  if (b==NULL) fmpq_floor(res, a);
+/* Set res to floor((a + b sqrt(q))/c), assuming c > 0.
+   Since a and c are integers, it suffices to round b sqrt(q) down first.
+   The scratch variable t must not alias any of the other arguments. */
+void fmpz_fdiv_quad(fmpz_t res, const fmpz_t a, const fmpz_t b,
+		    const fmpz_t c, int q, fmpz_t t) {
+  fmpz_mul(t, b, b);
+  fmpz_mul_si(t, t, q);
+  if (fmpz_sgn(b) >= 0) fmpz_sqrt_f(t, t);
   else {
-    fmpz *anum = fmpq_numref(a);
-    int anum_s = fmpz_sgn(anum);
-    fmpz *aden = fmpq_denref(a);
-    int aden_s = fmpz_sgn(aden);
-    fmpz *bnum = fmpq_numref(b);
-    int bnum_s = fmpz_sgn(bnum);
-    fmpz *bden = fmpq_denref(b);
-    int bden_s = fmpz_sgn(bden);
-    
-    fmpz_mul(res, aden, bnum);
-    fmpz_mul(res, res, res);
-    fmpz_mul_si(res, res, q);
-    if (bnum_s*bden_s >= 0) fmpz_sqrt_f(res, res);
-    else {
-      fmpz_sqrt_c(res, res);
-      fmpz_neg(res, res);
-    }
-    fmpz_mul_si(res, res, aden_s*bden_s);
-    fmpz_addmul(res, anum, bden);
-    if (bden_s > 0) fmpz_fdiv_q(res, res, aden);
-    else fmpz_cdiv_q(res, res, aden);
-    fmpz_fdiv_q(res, res, bden);
+    fmpz_sqrt_c(t, t);
+    fmpz_neg(t, t);
   }
+  fmpz_add(t, t, a);
+  fmpz_fdiv_q(res, t, c);
 }
 
-/* Set res to ceil(a + b sqrt(q)). */
-void fmpq_ceil_quad(fmpz_t res, const fmpq_t a,
-		     const fmpq_t b, int q) {
-  if (b==NULL) fmpq_ceil(res, a);
+/* Set res to ceil((a + b sqrt(q))/c), assuming c > 0. */
+void fmpz_cdiv_quad(fmpz_t res, const fmpz_t a, const fmpz_t b,
+		    const fmpz_t c, int q, fmpz_t t) {
+  fmpz_mul(t, b, b);
+  fmpz_mul_si(t, t, q);
+  if (fmpz_sgn(b) >= 0) fmpz_sqrt_c(t, t);
   else {
-    fmpz *anum = fmpq_numref(a);
-    int anum_s = fmpz_sgn(anum);
-    fmpz *aden = fmpq_denref(a);
-    int aden_s = fmpz_sgn(aden);
-    fmpz *bnum = fmpq_numref(b);
-    int bnum_s = fmpz_sgn(bnum);
-    fmpz *bden = fmpq_denref(b);
-    int bden_s = fmpz_sgn(bden);
-
-    fmpz_mul(res, aden, bnum);
-    fmpz_mul(res, res, res);
-    fmpz_mul_si(res, res, q);
-    if (bnum_s*bden_s >= 0) fmpz_sqrt_c(res, res);
-    else {
-      fmpz_sqrt_f(res, res);
-      fmpz_neg(res, res);
-    }
-    fmpz_mul_si(res, res, aden_s*bden_s);
-    fmpz_addmul(res, anum, bden);
-    if (bden_s > 0) fmpz_cdiv_q(res, res, aden);
-    else fmpz_fdiv_q(res, res, aden);
-    fmpz_cdiv_q(res, res, bden);
+    fmpz_sqrt_f(t, t);
+    fmpz_neg(t, t);
   }
+  fmpz_add(t, t, a);
+  fmpz_cdiv_q(res, t, c);
 }
 
-/* Memory allocation and release.
- */
-ps_static_data_t *ps_static_init(int d, int lead, int sign, int q,
-				 int cofactor, 
-				 int *modlist, 
-				 int verbosity, long node_count) {
-  int i, j;
-  ps_static_data_t *st_data;
-  fmpz_poly_t pol;
-  fmpz_t m, const1;
-  fmpq *k1;
+/* Return the sign of a + b sqrt(q), using t1 and t2 as scratch space. */
+int fmpz_sgn_quad(const fmpz_t a, const fmpz_t b, int q,
+		  fmpz_t t1, fmpz_t t2) {
+  int sa = fmpz_sgn(a), sb = fmpz_sgn(b), c;
+  if (sa == 0 || sa == sb) return(sb);
+  if (sb == 0) return(sa);
+  fmpz_mul(t1, a, a);
+  fmpz_mul(t2, b, b);
+  fmpz_mul_si(t2, t2, q);
+  c = fmpz_cmp(t1, t2);
+  return((c > 0) ? sa : (c < 0) ? sb : 0);
+}
 
-  fmpz_poly_init(pol);
-  fmpz_init(m);
-  fmpz_init_set_ui(const1, 1);
+/* Rewrite (a + b sqrt(q))/(e*(c + d sqrt(q))), assuming c + d sqrt(q) > 0
+   and e > 0, by multiplying through by the conjugate of the denominator.
+   Return 1 and set t to (a', b', c') with c' > 0, so that the quotient is
+   (a' + b' sqrt(q))/c'; or, if the conjugate vanishes (which can only
+   happen if q is a square), return 0 and set t to (a', c') with the
+   quotient a'/c'. The scratch vector t has length 4. */
+int _fmpz_quad_ratio(fmpz *t, const fmpz_t a, const fmpz_t b,
+		     const fmpz_t c, const fmpz_t d, const fmpz_t e, int q) {
+  fmpz_mul(t+2, c, c);
+  fmpz_mul(t+3, d, d);
+  fmpz_mul_si(t+3, t+3, q);
+  fmpz_sub(t+2, t+2, t+3);
+  if (fmpz_is_zero(t+2)) {
+    fmpz_set_si(t+3, q);
+    fmpz_sqrt(t+3, t+3);
+    fmpz_mul(t+2, d, t+3);
+    fmpz_add(t+2, t+2, c);
+    fmpz_mul(t+1, t+2, e);
+    fmpz_mul(t, b, t+3);
+    fmpz_add(t, t, a);
+    return(0);
+  }
+  fmpz_mul(t+2, t+2, e);
+  fmpz_mul(t, a, c);
+  fmpz_mul(t+3, b, d);
+  fmpz_mul_si(t+3, t+3, q);
+  fmpz_sub(t, t, t+3);
+  fmpz_mul(t+1, b, c);
+  fmpz_submul(t+1, a, d);
+  if (fmpz_sgn(t+2) < 0) {
+    fmpz_neg(t, t);
+    fmpz_neg(t+1, t+1);
+    fmpz_neg(t+2, t+2);
+  }
+  return(1);
+}
 
-  st_data = (ps_static_data_t *)malloc(sizeof(ps_static_data_t));
+/* Set res to floor((a + b sqrt(q))/(e*(c + d sqrt(q)))), under the
+   assumptions of _fmpz_quad_ratio. */
+void fmpz_fdiv_quad_ratio(fmpz_t res, const fmpz_t a, const fmpz_t b,
+			  const fmpz_t c, const fmpz_t d, const fmpz_t e,
+			  int q, fmpz *t) {
+  if (_fmpz_quad_ratio(t, a, b, c, d, e, q))
+    fmpz_fdiv_quad(res, t, t+1, t+2, q, t+3);
+  else fmpz_fdiv_q(res, t, t+1);
+}
 
-  st_data->d = d;
-  st_data->lead = lead;
-  st_data->sign = sign;
-  st_data->q = q;
-  st_data->verbosity = verbosity;
-  st_data->node_count = node_count;
+/* Set res to ceil((a + b sqrt(q))/(e*(c + d sqrt(q)))), likewise. */
+void fmpz_cdiv_quad_ratio(fmpz_t res, const fmpz_t a, const fmpz_t b,
+			  const fmpz_t c, const fmpz_t d, const fmpz_t e,
+			  int q, fmpz *t) {
+  if (_fmpz_quad_ratio(t, a, b, c, d, e, q))
+    fmpz_cdiv_quad(res, t, t+1, t+2, q, t+3);
+  else fmpz_cdiv_q(res, t, t+1);
+}
 
-  fmpz_init(st_data->a);
-  fmpz_init(st_data->b);
-  if (q==1) {
-    fmpz_set_si(st_data->a, -2);
-    fmpz_set_si(st_data->b, 2);
-  } else {
-    fmpz_set_si(st_data->a, 0);
-    fmpz_set_si(st_data->b, 4*q);    
+/* Set sum_col[k] to the k-th power sum of the roots of pol, scaled by
+   lead^k so as to be an integer, using Newton's identities:
+     S_k = -k a_{d-k} lead^{k-1} - sum_{i=1}^{k-1} a_{d-i} lead^{i-1} S_{k-i}.
+   This uses sum_col[1], ..., sum_col[k-1]. */
+void ps_power_sum(fmpz *sum_col, const fmpz *pol, const fmpz *lead_pow,
+		  int d, int k, fmpz_t t) {
+  int i;
+  fmpz *s = sum_col + k;
+
+  fmpz_mul_si(s, lead_pow+k-1, -k);
+  fmpz_mul(s, s, pol+d-k);
+  for (i=1; i<k; i++) {
+    fmpz_mul(t, pol+d-i, lead_pow+i-1);
+    fmpz_submul(s, t, sum_col+k-i);
   }
+}
 
-  st_data->cofactor = _fmpz_vec_init(3);
+/* Set c to the 3 coefficients of the cofactor numbered cofactor. */
+void ps_cofactor(fmpz *c, int cofactor, int q) {
   switch (cofactor) {
   case 0: /* Cofactor 1 */
-    fmpz_set_si(st_data->cofactor, 1);
-    fmpz_set_si(st_data->cofactor+1, 0);
-    fmpz_set_si(st_data->cofactor+2, 0);
+    fmpz_set_si(c, 1);
+    fmpz_set_si(c+1, 0);
+    fmpz_set_si(c+2, 0);
     break;
 
   case 1: /* Cofactor 1+q*x */
-    fmpz_set_si(st_data->cofactor, 1);
-    fmpz_set_si(st_data->cofactor+1, q);
-    fmpz_set_si(st_data->cofactor+2, 0);
+    fmpz_set_si(c, 1);
+    fmpz_set_si(c+1, q);
+    fmpz_set_si(c+2, 0);
     break;
 
   case 2:  /* Cofactor 1-q*x */
-    fmpz_set_si(st_data->cofactor, 1);
-    fmpz_set_si(st_data->cofactor+1, -q);
-    fmpz_set_si(st_data->cofactor+2, 0);
+    fmpz_set_si(c, 1);
+    fmpz_set_si(c+1, -q);
+    fmpz_set_si(c+2, 0);
     break;
 
   case 3: /* Cofactor 1-q*x^2 */
-    fmpz_set_si(st_data->cofactor, 1);
-    fmpz_set_si(st_data->cofactor+1, 0);
-    fmpz_set_si(st_data->cofactor+2, -q);
+    fmpz_set_si(c, 1);
+    fmpz_set_si(c+1, 0);
+    fmpz_set_si(c+2, -q);
     break;
   }
+}
 
-  st_data->modlist =_fmpz_vec_init(d+1);
-  st_data->f = _fmpq_vec_init(d+1);
+/* Convert pol back into symmetric form, with 2*d+3 coefficients. */
+void ps_symmetrize(fmpz *sympol, const fmpz *pol, int d, int q, int sign,
+		   const fmpz *cofactor, fmpz_t temp) {
+  int i, j;
+
+  _fmpz_vec_zero(sympol, 2*d+3);
   for (i=0; i<=d; i++) {
-    fmpz_set_si(st_data->modlist+i, modlist[i]);
-    fmpq_set_si(st_data->f+i, d-i, lead);
-    fmpq_mul_fmpz(st_data->f+i, st_data->f+i, st_data->modlist+i);
+    fmpz_one(temp);
+    for (j=0; j<=i; j++) {
+      fmpz_addmul(sympol+d-i+2*j, pol+i, temp);
+      if (j<i) {
+	fmpz_mul_si(temp, temp, q);
+	fmpz_mul_si(temp, temp, i-j);
+	fmpz_divexact_si(temp, temp, j+1);
+      }
+    }
   }
+  _fmpz_vec_scalar_mul_si(sympol, sympol, 2*d+1, sign);
+  _fmpz_poly_mul_KS(sympol,sympol, 2*d+1, cofactor, 3);
+}
+
+/* Memory allocation and release.
+ */
+/* Tables depending only on d, q and lead, shared by all static data
+   with these parameters.
+
+   These are kept in a list, most recently used first, and reference
+   counted. Up to PS_STATIC_CACHE tables which are no longer referenced
+   are kept as well, so that a sequence of searches with the same
+   parameters (as in make_table or search-test.sage) builds them once.
+*/
+
+#define PS_STATIC_CACHE 8
+
+static ps_static_table_t *ps_static_tables = NULL;
+static pthread_mutex_t ps_static_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ps_static_table_t *ps_static_table_init(int d, int q, int lead) {
+  int i, j, r;
+  ps_static_table_t *table;
+  fmpz_poly_t pol;
+  fmpz_t m;
+  fmpz *k1;
+
+  fmpz_poly_init(pol);
+  fmpz_init(m);
+
+  table = (ps_static_table_t *)malloc(sizeof(ps_static_table_t));
+  table->d = d;
+  table->q = q;
+  table->lead = lead;
+  table->refs = 0;
 
-  fmpz_mat_init(st_data->binom_mat, d+1, d+1);
+  /* The k-th power sum is stored multiplied by lead^k, so that all of
+     the arithmetic in set_range_from_power_sums is over the integers. */
+  table->lead_pow = _fmpz_vec_init(d+2);
+  fmpz_one(table->lead_pow);
+  for (i=1; i<=d+1; i++)
+    fmpz_mul_si(table->lead_pow+i, table->lead_pow+i-1, lead);
+
+  fmpz_mat_init(table->binom_mat, d+1, d+1);
   for (i=0; i<=d; i++)
     for (j=0; j<=d; j++)
-      fmpz_bin_uiui(fmpz_mat_entry(st_data->binom_mat, i, j), i, j);
+      fmpz_bin_uiui(fmpz_mat_entry(table->binom_mat, i, j), i, j);
   
-  st_data->sum_mats = (fmpq_mat_t *)malloc((d+1)*sizeof(fmpq_mat_t));
+  table->sum_mats = (fmpz_mat_t *)malloc((d+1)*sizeof(fmpz_mat_t));
   for (i=0; i<=d; i++) {
 
-    fmpq_mat_init(st_data->sum_mats[i], 9, d+1);
-    fmpq_mat_zero(st_data->sum_mats[i]);
+    fmpz_mat_init(table->sum_mats[i], 9, d+1);
 
     arith_chebyshev_t_polynomial(pol, i);
     for (j=0; j<=d; j++) {
@@ -202,123 +277,483 @@ ps_static_data_t *ps_static_init(int d, int lead, int sign, int q,
       /* Row 0: coeffs of 2*(i-th Chebyshev polynomial)(x/2). 
          If q != 1, the coeff of x^j is multiplied by q^{floor(i-j)/2}. */
       if (j <= i) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 0, j);
-	fmpq_set_fmpz_frac(k1, fmpz_poly_get_coeff_ptr(pol, j), const1);
-	fmpz_mul_2exp(m, const1, j);
-	fmpq_div_fmpz(k1, k1, m);
-	fmpz_set_ui(m, 2);
-	fmpq_mul_fmpz(k1, k1, m);
+	k1 = fmpz_mat_entry(table->sum_mats[i], 0, j);
+	fmpz_mul_2exp(k1, fmpz_poly_get_coeff_ptr(pol, j), 1);
+	fmpz_fdiv_q_2exp(k1, k1, j);
 	if (q != 1 && i%2==j%2) {
 	  fmpz_set_ui(m, q);
 	  fmpz_pow_ui(m, m, (i-j)/2); 
-	  fmpq_mul_fmpz(k1, k1, m);
+	  fmpz_mul(k1, k1, m);
 	}
       }
 
-      /* The other rows are currently used only when q==1. */
+      /* The other rows are stated for q == 1, with 2 standing for 
+         2 sqrt(q) in general; for q != 1, see rows 3 and 6. */
       
-      /* Row 1: coeffs of row 0 from matrix i-2, multiplied by -2. */
+      /* Row 1: coeffs of row 0 from matrix i-2, multiplied by -2q. */
       if (i >= 2) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 1, j);
-	fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i-2], 0, j));
-	fmpz_set_si(m, -2);
-	fmpq_mul_fmpz(k1, k1, m);
+	k1 = fmpz_mat_entry(table->sum_mats[i], 1, j);
+	fmpz_mul_si(k1, fmpz_mat_entry(table->sum_mats[i-2], 0, j), -2*q);
       }
 
       /* Row 2: coeffs of row 0 from matrix i-2, shifted by 2. */
       if (i>= 2 && j >= 2) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 2, j);
-	fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i-2], 0, j-2));
+	k1 = fmpz_mat_entry(table->sum_mats[i], 2, j);
+	fmpz_set(k1, fmpz_mat_entry(table->sum_mats[i-2], 0, j-2));
       }
 
-      /* Row 3: coeffs of (2+x)^i. */
-      if (j<= i) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 3, j);
-	fmpq_set_fmpz_frac(k1, fmpz_mat_entry(st_data->binom_mat, i, j), const1);
-	fmpq_mul_2exp(k1, k1, i-j);
+      /* Row 3: coeffs of (2+x)^i. 
+         If q != 1, only the terms of (2 sqrt(q) + x)^i with i-j even. */
+      if (j<= i && (q == 1 || (i-j)%2==0)) {
+	k1 = fmpz_mat_entry(table->sum_mats[i], 3, j);
+	fmpz_mul_2exp(k1, fmpz_mat_entry(table->binom_mat, i, j), i-j);
+	if (q != 1) {
+	  fmpz_set_ui(m, q);
+	  fmpz_pow_ui(m, m, (i-j)/2);
+	  fmpz_mul(k1, k1, m);
+	}
       }
       
       /* Row 4: coeffs of (2+x)^(i-1). */
       if (i >= 1) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 4, j);
-	fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i-1], 3, j));	
+	k1 = fmpz_mat_entry(table->sum_mats[i], 4, j);
+	fmpz_set(k1, fmpz_mat_entry(table->sum_mats[i-1], 3, j));	
       }
 
       /* Row 5: coeffs of (2+x)^(i-2). */
       if (i>=2)	{
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 5, j);
-	fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i-2], 3, j));	
+	k1 = fmpz_mat_entry(table->sum_mats[i], 5, j);
+	fmpz_set(k1, fmpz_mat_entry(table->sum_mats[i-2], 3, j));	
       }
 
-      /* Row 6: coeffs of (-2+x)^i. */
-      k1 = fmpq_mat_entry(st_data->sum_mats[i], 6, j);
-      fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i], 3, j));
-      if ((i-j)%2==1) fmpq_neg(k1, k1);
+      /* Row 6: coeffs of (-2+x)^i. 
+         If q != 1, the terms of (2 sqrt(q) + x)^i with i-j odd, divided
+         by sqrt(q); the sums of (-2 sqrt(q) + x)^i are then the conjugates
+         of those of (2 sqrt(q) + x)^i. */
+      k1 = fmpz_mat_entry(table->sum_mats[i], 6, j);
+      if (q == 1) {
+	fmpz_set(k1, fmpz_mat_entry(table->sum_mats[i], 3, j));
+	if ((i-j)%2==1) fmpz_neg(k1, k1);
+      } else if (j <= i && (i-j)%2==1) {
+	fmpz_mul_2exp(k1, fmpz_mat_entry(table->binom_mat, i, j), i-j);
+	fmpz_set_ui(m, q);
+	fmpz_pow_ui(m, m, (i-j)/2);
+	fmpz_mul(k1, k1, m);
+      }
 
       /* Row 7: coeffs of (-2+x)^(i-1). */
       if (i >= 1) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 7, j);
-	fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i-1], 6, j));	
+	k1 = fmpz_mat_entry(table->sum_mats[i], 7, j);
+	fmpz_set(k1, fmpz_mat_entry(table->sum_mats[i-1], 6, j));	
       }
 
       /* Row 8: coeffs of (-2+x)^(i-2). */
       if (i >= 2) {
-	k1 = fmpq_mat_entry(st_data->sum_mats[i], 8, j);
-	fmpq_set(k1, fmpq_mat_entry(st_data->sum_mats[i-2], 6, j));
+	k1 = fmpz_mat_entry(table->sum_mats[i], 8, j);
+	fmpz_set(k1, fmpz_mat_entry(table->sum_mats[i-2], 6, j));
       }
 
     }
   }
+
+  /* Scale column j of sum_mats[i] by lead^(i-j), to match the scaling
+     of the power sums. (All entries with j>i are zero.) */
+  for (i=0; i<=d; i++)
+    for (r=0; r<9; r++)
+      for (j=0; j<i; j++) {
+	k1 = fmpz_mat_entry(table->sum_mats[i], r, j);
+	fmpz_mul(k1, k1, table->lead_pow+i-j);
+      }
   
   fmpz_poly_clear(pol);
   fmpz_clear(m);
-  fmpz_clear(const1);
+  return(table);
+}
+
+static void ps_static_table_clear(ps_static_table_t *table) {
+  int i;
+  _fmpz_vec_clear(table->lead_pow, table->d+2);
+  fmpz_mat_clear(table->binom_mat);
+  for (i=0; i<=table->d; i++)
+    fmpz_mat_clear(table->sum_mats[i]);
+  free(table->sum_mats);
+  free(table);
+}
+
+static ps_static_table_t *ps_static_table_find(int d, int q, int lead) {
+  ps_static_table_t *table, **p;
+  for (p=&ps_static_tables; *p != NULL; p=&(*p)->next) {
+    table = *p;
+    if (table->d == d && table->q == q && table->lead == lead) {
+      *p = table->next;
+      return(table);
+    }
+  }
+  return(NULL);
+}
+
+/* Return the table for (d, q, lead), with its reference count increased. */
+ps_static_table_t *ps_static_table_get(int d, int q, int lead) {
+  ps_static_table_t *table, *table2;
+
+  pthread_mutex_lock(&ps_static_tables_lock);
+  table = ps_static_table_find(d, q, lead);
+  if (table == NULL) {
+    /* Build the table without holding the lock; if another thread has
+       done the same meanwhile, use its table. */
+    pthread_mutex_unlock(&ps_static_tables_lock);
+    table2 = ps_static_table_init(d, q, lead);
+    pthread_mutex_lock(&ps_static_tables_lock);
+    table = ps_static_table_find(d, q, lead);
+    if (table == NULL) table = table2;
+    else ps_static_table_clear(table2);
+  }
+  table->refs += 1;
+  table->next = ps_static_tables;
+  ps_static_tables = table;
+  pthread_mutex_unlock(&ps_static_tables_lock);
+  return(table);
+}
+
+/* Drop unreferenced tables beyond the first keep of them. */
+static void ps_static_tables_trim(int keep) {
+  ps_static_table_t *table, **p;
+
+  p = &ps_static_tables;
+  while (*p != NULL) {
+    table = *p;
+    if (table->refs == 0 && keep-- <= 0) {
+      *p = table->next;
+      ps_static_table_clear(table);
+    } else p = &table->next;
+  }
+}
+
+void ps_static_table_release(ps_static_table_t *table) {
+  pthread_mutex_lock(&ps_static_tables_lock);
+  table->refs -= 1;
+  if (table->refs == 0) ps_static_tables_trim(PS_STATIC_CACHE);
+  pthread_mutex_unlock(&ps_static_tables_lock);
+}
+
+/* Free all tables which are no longer referenced. */
+void ps_static_cache_clear() {
+  pthread_mutex_lock(&ps_static_tables_lock);
+  ps_static_tables_trim(0);
+  pthread_mutex_unlock(&ps_static_tables_lock);
+}
+
+ps_static_data_t *ps_static_init(int d, int lead, int sign, int q,
+				 int cofactor, 
+				 int *modlist, 
+				 int verbosity, long node_count,
+				 int *point_count, int *newton) {
+  int i, j, r;
+  ps_static_data_t *st_data;
+  fmpz_t m;
+  fmpz *k1, *c;
+
+  fmpz_init(m);
+
+  st_data = (ps_static_data_t *)malloc(sizeof(ps_static_data_t));
+
+  st_data->d = d;
+  st_data->lead = lead;
+  st_data->sign = sign;
+  st_data->q = q;
+  st_data->verbosity = verbosity;
+  st_data->node_count = node_count;
+  st_data->sturm_bisect = 0;
+  st_data->hankel = 0;
+  st_data->filter = 0;
+  st_data->count_only = 0;
+  st_data->order = PS_ORDER_LINEAR;
+
+  fmpz_init(st_data->a);
+  fmpz_init(st_data->b);
+  if (q==1) {
+    fmpz_set_si(st_data->a, -2);
+    fmpz_set_si(st_data->b, 2);
+  } else {
+    fmpz_set_si(st_data->a, 0);
+    fmpz_set_si(st_data->b, 4*q);    
+  }
+
+  st_data->cofactor = _fmpz_vec_init(3);
+  ps_cofactor(st_data->cofactor, cofactor, q);
+
+  st_data->table = ps_static_table_get(d, q, lead);
+  st_data->lead_pow = st_data->table->lead_pow;
+  st_data->binom_mat = st_data->table->binom_mat;
+  st_data->sum_mats = st_data->table->sum_mats;
+
+  /* f[i] = (d-i)*modlist[i]/lead, scaled by lead^(d-i). */
+  st_data->modlist =_fmpz_vec_init(d+1);
+  st_data->f = _fmpz_vec_init(d+1);
+  for (i=0; i<=d; i++) {
+    fmpz_set_si(st_data->modlist+i, modlist[i]);
+    if (i<d) {
+      fmpz_mul_si(st_data->f+i, st_data->lead_pow+d-i-1, d-i);
+      fmpz_mul(st_data->f+i, st_data->f+i, st_data->modlist+i);
+    }
+  }
+
+  /* count_a[k] = lead^k (e0 + e1 p^k + e2 p^(2k) + sign p^(wk) c_k) and
+     count_b[k] = sign p^(wk), where c_k is the sum of the k-th powers of
+     the reciprocal roots of the cofactor. */
+  st_data->point_count = NULL;
+  if (point_count != NULL) {
+    st_data->point_count = (int *)malloc(6*sizeof(int));
+    for (i=0; i<6; i++) st_data->point_count[i] = point_count[i];
+    st_data->count_a = _fmpz_vec_init(d+1);
+    st_data->count_b = _fmpz_vec_init(d+1);
+    c = _fmpz_vec_init(d+1);
+    fmpz_set_si(c, fmpz_is_zero(st_data->cofactor+2) ?
+		!fmpz_is_zero(st_data->cofactor+1) : 2);
+    for (i=1; i<=d; i++) {
+      /* Newton's identities, with c[0] the degree of the cofactor. */
+      if (i == 1) fmpz_set(c+1, st_data->cofactor+1);
+      else {
+	fmpz_mul(c+i, st_data->cofactor+1, c+i-1);
+	fmpz_addmul(c+i, st_data->cofactor+2, c+i-2);
+      }
+      fmpz_neg(c+i, c+i);
+
+      fmpz_set_si(m, point_count[0]);
+      fmpz_pow_ui(m, m, point_count[5]*i);
+      fmpz_mul_si(st_data->count_b+i, m, point_count[4]);
+      fmpz_mul(st_data->count_a+i, st_data->count_b+i, c+i);
+      for (j=0; j<=2; j++) {
+	fmpz_set_si(m, point_count[0]);
+	fmpz_pow_ui(m, m, j*i);
+	fmpz_mul_si(m, m, point_count[j+1]);
+	fmpz_add(st_data->count_a+i, st_data->count_a+i, m);
+      }
+      fmpz_mul(st_data->count_a+i, st_data->count_a+i, st_data->lead_pow+i);
+    }
+    _fmpz_vec_clear(c, d+1);
+  }
+
+  /* newton_mat[k][i] = binomial(d-i, (k-i)/2) q^((k-i)/2) for i <= k of
+     the same parity, so that a_k = sum_i newton_mat[k][i] pol[d-i].
+     Set newton_lo[k] = p^(lo_k+v), newton_hi[k] = p^(hi_k+v+1) where
+     v = v_p(lead), or 1 and 0 respectively if there is no bound. */
+  st_data->newton = NULL;
+  if (newton != NULL) {
+    st_data->newton = (int *)malloc((2*d+1)*sizeof(int));
+    for (i=0; i<=2*d; i++) st_data->newton[i] = newton[i];
+    fmpz_mat_init(st_data->newton_mat, d+1, d+1);
+    for (i=0; i<=d; i++)
+      for (j=i; j<=d; j+=2) {
+	k1 = fmpz_mat_entry(st_data->newton_mat, j, i);
+	fmpz_bin_uiui(k1, d-i, (j-i)/2);
+	fmpz_set_si(m, q);
+	fmpz_pow_ui(m, m, (j-i)/2);
+	fmpz_mul(k1, k1, m);
+      }
+    fmpz_set_si(m, lead);
+    fmpz_abs(m, m);
+    for (r=0; fmpz_divisible_si(m, newton[0]); r++)
+      fmpz_divexact_si(m, m, newton[0]);
+    st_data->newton_lo = _fmpz_vec_init(d+1);
+    st_data->newton_hi = _fmpz_vec_init(d+1);
+    for (i=1; i<=d; i++) {
+      fmpz_one(st_data->newton_lo+i);
+      if (newton[i] >= 0) {
+	fmpz_set_si(m, newton[0]);
+	fmpz_pow_ui(st_data->newton_lo+i, m, newton[i]+r);
+      }
+      if (newton[d+i] >= 0) {
+	fmpz_set_si(m, newton[0]);
+	fmpz_pow_ui(st_data->newton_hi+i, m, newton[d+i]+r+1);
+      }
+    }
+  }
+
+  fmpz_clear(m);
 
   return(st_data);
 }
 
+/* Memory for dynamic data.
+
+   Each state lives in a single block: the struct itself, then its fmpz
+   vectors, then ws, the stats counters and sturm_ok. The vectors which
+   describe the node (pol, upper, sum_col, hk, wrap_lo and wrap_hi) come
+   first and are adjacent, so that ps_dynamic_clone copies them in one
+   pass; the rest is scratch space.
+
+   Blocks released by ps_dynamic_clear are kept on a free list owned by
+   the calling thread (up to PS_DYNAMIC_CACHE of them, all of the same
+   degree), and reused by the next ps_dynamic_init or ps_dynamic_clone in
+   that thread. The coefficients left in a reused block are valid fmpz's,
+   so only those which matter are reset. Once a search is under way,
+   splitting and cloning states thus involves no calls to malloc.
+*/
+
+#define PS_DYNAMIC_CACHE 64
+
+typedef struct ps_dynamic_cache {
+  ps_dynamic_data_t *head;
+  int len;
+} ps_dynamic_cache_t;
+
+static pthread_key_t ps_dynamic_cache_key;
+static pthread_once_t ps_dynamic_cache_once = PTHREAD_ONCE_INIT;
+
+static int ps_dynamic_hklen(int d) {
+  return(2*(d/2+1)*(d/2+1) + 3*(d/2+1));
+}
+
+/* Number of fmpz's in a block, and of those copied by ps_dynamic_clone. */
+static slong ps_dynamic_fmpz_len(int d) {
+  return(5*(d+1) + ps_dynamic_hklen(d) + (2*d+3) + 9 + (4*d+20) + (8*d+18));
+}
+
+static slong ps_dynamic_node_len(ps_dynamic_data_t *dy_data) {
+  return(5*(dy_data->d+1) + dy_data->hklen);
+}
+
+static size_t ps_dynamic_size(int d) {
+  size_t size = sizeof(ps_dynamic_data_t) + ps_dynamic_fmpz_len(d)*sizeof(fmpz)
+    + (4*d+4)*sizeof(slong) + (d+1)*sizeof(int);
+#ifdef PS_STATS
+  size += (d+1)*sizeof(ps_stats_t);
+#endif
+  return(size);
+}
+
+static void ps_dynamic_free(ps_dynamic_data_t *dy_data) {
+  slong i, len = ps_dynamic_fmpz_len(dy_data->d);
+  for (i=0; i<len; i++) fmpz_clear(dy_data->pol+i);
+  free(dy_data);
+}
+
+static void ps_dynamic_cache_flush(ps_dynamic_cache_t *cache) {
+  ps_dynamic_data_t *dy_data;
+  while (cache->head != NULL) {
+    dy_data = cache->head;
+    cache->head = dy_data->next;
+    ps_dynamic_free(dy_data);
+  }
+  cache->len = 0;
+}
+
+static void ps_dynamic_cache_destroy(void *arg) {
+  ps_dynamic_cache_flush((ps_dynamic_cache_t *)arg);
+  free(arg);
+}
+
+static void ps_dynamic_cache_key_init() {
+  pthread_key_create(&ps_dynamic_cache_key, ps_dynamic_cache_destroy);
+}
+
+static ps_dynamic_cache_t *ps_dynamic_cache() {
+  ps_dynamic_cache_t *cache;
+  pthread_once(&ps_dynamic_cache_once, ps_dynamic_cache_key_init);
+  cache = (ps_dynamic_cache_t *)pthread_getspecific(ps_dynamic_cache_key);
+  if (cache == NULL) {
+    cache = (ps_dynamic_cache_t *)calloc(1, sizeof(ps_dynamic_cache_t));
+    pthread_setspecific(ps_dynamic_cache_key, cache);
+  }
+  return(cache);
+}
+
+/* Free the blocks cached by the calling thread. Those of other threads
+   are freed when these exit. */
+void ps_dynamic_cache_clear() {
+  ps_dynamic_cache_flush(ps_dynamic_cache());
+}
+
+/* Return a block for degree d, with the pointers set up and the stats
+   counters and sturm_ok zeroed; the fmpz's are left as they are. */
+static ps_dynamic_data_t *ps_dynamic_alloc(int d) {
+  ps_dynamic_cache_t *cache = ps_dynamic_cache();
+  ps_dynamic_data_t *dy_data;
+  fmpz *v;
+  slong i, len;
+
+  if (cache->head != NULL && cache->head->d == d) {
+    dy_data = cache->head;
+    cache->head = dy_data->next;
+    cache->len -= 1;
+  } else {
+    dy_data = (ps_dynamic_data_t *)calloc(1, ps_dynamic_size(d));
+    dy_data->d = d;
+    len = ps_dynamic_fmpz_len(d);
+    for (i=0; i<len; i++) fmpz_init((fmpz *)(dy_data+1) + i);
+    dy_data->hklen = ps_dynamic_hklen(d);
+    dy_data->wlen = 4*d+20;
+    dy_data->wslen = 4*d+4;
+    dy_data->wplen = 8*d+18;
+
+    v = (fmpz *)(dy_data+1);
+    dy_data->pol = v;
+    dy_data->upper = v += d+1;
+    dy_data->sum_col = v += d+1;
+    dy_data->hk = v += d+1;
+    dy_data->wrap_lo = v += dy_data->hklen;
+    dy_data->wrap_hi = v += d+1;
+    dy_data->sympol = v += d+1;
+    dy_data->sum_prod = v += 2*d+3;
+    dy_data->w = v += 9;
+    dy_data->wp = v += dy_data->wlen;
+    dy_data->ws = (slong *)(v + dy_data->wplen);
+#ifdef PS_STATS
+    dy_data->stats = (ps_stats_t *)(dy_data->ws + dy_data->wslen);
+    dy_data->sturm_ok = (int *)(dy_data->stats + d+1);
+#else
+    dy_data->stats = NULL;
+    dy_data->sturm_ok = (int *)(dy_data->ws + dy_data->wslen);
+#endif
+    return(dy_data);
+  }
+  dy_data->next = NULL;
+  memset(dy_data->sturm_ok, 0, (d+1)*sizeof(int));
+  if (dy_data->stats != NULL)
+    memset(dy_data->stats, 0, (d+1)*sizeof(ps_stats_t));
+  return(dy_data);
+}
+
 ps_dynamic_data_t *ps_dynamic_init(int d, int *Q0) {
   ps_dynamic_data_t *dy_data;
   int i;
 
-  dy_data = (ps_dynamic_data_t *)malloc(sizeof(ps_dynamic_data_t));
-  dy_data->d = d;
+  dy_data = ps_dynamic_alloc(d);
+  _fmpz_vec_zero(dy_data->pol, ps_dynamic_fmpz_len(d));
 
   /* Initialize mutable quantities */
   dy_data->n = d;
   dy_data->count = 0;
+  dy_data->solutions = 0;
   dy_data->ascend = 0;
-  dy_data->pol = _fmpz_vec_init(d+1);
-  dy_data->sympol = _fmpz_vec_init(2*d+3);
+  dy_data->job = 0;
+  dy_data->interrupt = NULL;
+  dy_data->count_limit = -1;
   if (Q0 != NULL) 
     for (i=0; i<=d; i++) 
       fmpz_set_si(dy_data->pol+i, Q0[i]);
-  
-  fmpq_mat_init(dy_data->sum_col, d+1, 1);
-  fmpq_set_si(fmpq_mat_entry(dy_data->sum_col, 0, 0), d, 1);
-
-  dy_data->upper = _fmpz_vec_init(d+1);
-
-  /* Allocate scratch space */
-  fmpq_mat_init(dy_data->sum_prod, 9, 1);
-  dy_data->wlen = 4*d+12;
-  dy_data->w = _fmpz_vec_init(dy_data->wlen);
-  dy_data->w2len = 5;
-  dy_data->w2 = _fmpq_vec_init(dy_data->w2len);
+  for (i=0; i<=d; i++) fmpz_one(dy_data->wrap_lo+i);
+  fmpz_set_si(dy_data->sum_col, d);
+  dy_data->hk_n = 1;
   return(dy_data);
 }
 
 ps_dynamic_data_t *ps_dynamic_clone(ps_dynamic_data_t *dy_data) {
   ps_dynamic_data_t *dy_data2;
-  int i, d = dy_data->d;
+  int d = dy_data->d;
 
-  dy_data2 = ps_dynamic_init(d, NULL);
+  dy_data2 = ps_dynamic_alloc(d);
   dy_data2->n = dy_data->n;
   dy_data2->count = dy_data->count;
+  dy_data2->solutions = dy_data->solutions;
   dy_data2->ascend = dy_data->ascend;
-  _fmpz_vec_set(dy_data2->pol, dy_data->pol, d+1);
-  _fmpz_vec_set(dy_data2->upper, dy_data->upper, d+1);
-  fmpq_mat_set(dy_data2->sum_col, dy_data->sum_col);
+  dy_data2->job = dy_data->job;
+  dy_data2->interrupt = NULL;
+  dy_data2->count_limit = -1;
+  _fmpz_vec_set(dy_data2->pol, dy_data->pol, ps_dynamic_node_len(dy_data));
+  memcpy(dy_data2->sturm_ok, dy_data->sturm_ok, (d+1)*sizeof(int));
+  dy_data2->hk_n = dy_data->hk_n;
   return(dy_data2);
 }
 
@@ -326,15 +761,21 @@ ps_dynamic_data_t *ps_dynamic_split(ps_dynamic_data_t *dy_data) {
   if (dy_data==NULL) return(NULL);
 
   ps_dynamic_data_t *dy_data2;
-  int i, d = dy_data->d, n = dy_data->n;
+  int i, j, d = dy_data->d, n = dy_data->n;
 
   for (i=d; i>n+1; i--)
     if (fmpz_cmp(dy_data->pol+i, dy_data->upper+i) <0) {
       dy_data2 = ps_dynamic_clone(dy_data);
       fmpz_set(dy_data->upper+i, dy_data->pol+i);
+      /* Values pending with PS_ORDER_CENTER stay with dy_data. */
+      for (j=0; j<=d; j++) {
+	fmpz_one(dy_data2->wrap_lo+j);
+	fmpz_zero(dy_data2->wrap_hi+j);
+      }
       dy_data2->n = i-1;
       dy_data2->ascend = 1;
       dy_data2->count = 0;
+      dy_data2->solutions = 0;
       return(dy_data2);
   }
   return(NULL);
@@ -358,30 +799,695 @@ long extract_count(ps_dynamic_data_t *dy_data) {
   return(dy_data->count);
 }
 
+long extract_solutions(ps_dynamic_data_t *dy_data) {
+  return(dy_data->solutions);
+}
+
+/* Return 1 if the counters in ps_stats_t are maintained. */
+int ps_stats_enabled() {
+#ifdef PS_STATS
+  return(1);
+#else
+  return(0);
+#endif
+}
+
+/* Add the d+1 counters in stats (if not NULL) to res. */
+void ps_stats_add(ps_stats_t *res, const ps_stats_t *stats, int d) {
+  int n, k;
+  if (stats == NULL) return;
+  for (n=0; n<=d; n++) {
+    res[n].nodes += stats[n].nodes;
+    res[n].sturm_fail += stats[n].sturm_fail;
+    res[n].empty += stats[n].empty;
+    res[n].early_abort += stats[n].early_abort;
+    for (k=0; k<PS_STATS_SKIP; k++)
+      res[n].early_skip[k] += stats[n].early_skip[k];
+    res[n].width += stats[n].width;
+    res[n].interval_cycles += stats[n].interval_cycles;
+    res[n].real_cycles += stats[n].real_cycles;
+    res[n].bound_cycles += stats[n].bound_cycles;
+  }
+}
+
 void ps_static_clear(ps_static_data_t *st_data) {
-  int i, d = st_data->d;
+  int d = st_data->d;
   fmpz_clear(st_data->a);
   fmpz_clear(st_data->b);
   _fmpz_vec_clear(st_data->cofactor, 3);
-  fmpz_mat_clear(st_data->binom_mat);
-  _fmpq_vec_clear(st_data->f, d+1);
+  _fmpz_vec_clear(st_data->f, d+1);
   _fmpz_vec_clear(st_data->modlist, d+1);
-  for (i=0; i<=d; i++) 
-    fmpq_mat_clear(st_data->sum_mats[i]);
-  free(st_data->sum_mats);
+  ps_static_table_release(st_data->table);
+  if (st_data->point_count != NULL) {
+    free(st_data->point_count);
+    _fmpz_vec_clear(st_data->count_a, d+1);
+    _fmpz_vec_clear(st_data->count_b, d+1);
+  }
+  if (st_data->newton != NULL) {
+    free(st_data->newton);
+    fmpz_mat_clear(st_data->newton_mat);
+    _fmpz_vec_clear(st_data->newton_lo, d+1);
+    _fmpz_vec_clear(st_data->newton_hi, d+1);
+  }
   free(st_data);
 }
 
 void ps_dynamic_clear(ps_dynamic_data_t *dy_data) {
-  int d = dy_data->d;
-  _fmpz_vec_clear(dy_data->pol, d+1);
-  _fmpz_vec_clear(dy_data->sympol, 2*d+3);
-  _fmpz_vec_clear(dy_data->upper, d+1);
-  fmpq_mat_clear(dy_data->sum_col);
-  fmpq_mat_clear(dy_data->sum_prod);
-  _fmpz_vec_clear(dy_data->w, dy_data->wlen);
-  _fmpq_vec_clear(dy_data->w2, dy_data->w2len);
-  free(dy_data);
+  ps_dynamic_cache_t *cache = ps_dynamic_cache();
+
+  if (cache->head != NULL && cache->head->d != dy_data->d)
+    ps_dynamic_cache_flush(cache);
+  if (cache->len >= PS_DYNAMIC_CACHE) {
+    ps_dynamic_free(dy_data);
+    return;
+  }
+  dy_data->next = cache->head;
+  cache->head = dy_data;
+  cache->len += 1;
+}
+
+/* Serialization, for checkpointing.
+ */
+
+/* Write the parameters of ps_static_init, in the same order. */
+void ps_static_fprint(FILE *f, ps_static_data_t *st_data) {
+  int i, d = st_data->d, cofactor;
+  fmpz *c = st_data->cofactor;
+
+  if (!fmpz_is_zero(c+2)) cofactor = 3;
+  else if (fmpz_sgn(c+1) > 0) cofactor = 1;
+  else if (fmpz_sgn(c+1) < 0) cofactor = 2;
+  else cofactor = 0;
+  fprintf(f, "%d %d %d %d %d %d %ld\n", d, st_data->lead, st_data->sign,
+	  st_data->q, cofactor, st_data->verbosity, st_data->node_count);
+  for (i=0; i<=d; i++) {
+    fmpz_fprint(f, st_data->modlist+i);
+    fprintf(f, i<d ? " " : "\n");
+  }
+  if (st_data->point_count == NULL) fprintf(f, "0\n");
+  else {
+    fprintf(f, "1");
+    for (i=0; i<6; i++) fprintf(f, " %d", st_data->point_count[i]);
+    fprintf(f, "\n");
+  }
+  if (st_data->newton == NULL) fprintf(f, "0\n");
+  else {
+    fprintf(f, "1");
+    for (i=0; i<=2*d; i++) fprintf(f, " %d", st_data->newton[i]);
+    fprintf(f, "\n");
+  }
+}
+
+/* Write n, ascend, count, pol and upper on one line, followed by the
+   solutions counted in count-only mode and the values pending with
+   PS_ORDER_CENTER (wrap_lo, then wrap_hi), if any. The power sums are
+   not written, as they are determined by pol. */
+void ps_dynamic_fprint(FILE *f, ps_dynamic_data_t *dy_data) {
+  int i, d = dy_data->d, wrap = 0;
+
+  fprintf(f, "%d %d %ld", dy_data->n, dy_data->ascend, dy_data->count);
+  for (i=0; i<=d; i++) {
+    fprintf(f, " ");
+    fmpz_fprint(f, dy_data->pol+i);
+  }
+  for (i=0; i<=d; i++) {
+    fprintf(f, " ");
+    fmpz_fprint(f, dy_data->upper+i);
+  }
+  for (i=0; i<=d; i++)
+    if (fmpz_cmp(dy_data->wrap_lo+i, dy_data->wrap_hi+i) <= 0) wrap = 1;
+  if (dy_data->solutions != 0 || wrap)
+    fprintf(f, " %ld", dy_data->solutions);
+  if (wrap) for (i=0; i<=2*d+1; i++) {
+      fprintf(f, " ");
+      fmpz_fprint(f, dy_data->wrap_lo+i);
+    }
+  fprintf(f, "\n");
+}
+
+/* Read back a state written by ps_dynamic_fprint; return NULL on failure. */
+ps_dynamic_data_t *ps_dynamic_fread(FILE *f, int d) {
+  ps_dynamic_data_t *dy_data;
+  int i, k, c;
+  fmpz *lead_pow;
+
+  dy_data = ps_dynamic_init(d, NULL);
+  if (fscanf(f, "%d %d %ld", &dy_data->n, &dy_data->ascend,
+	     &dy_data->count) != 3) {
+    ps_dynamic_clear(dy_data);
+    return(NULL);
+  }
+  for (i=0; i<=d; i++)
+    if (!fmpz_fread(f, dy_data->pol+i)) {
+      ps_dynamic_clear(dy_data);
+      return(NULL);
+    }
+  for (i=0; i<=d; i++)
+    if (!fmpz_fread(f, dy_data->upper+i)) {
+      ps_dynamic_clear(dy_data);
+      return(NULL);
+    }
+  /* The solution count and the pending values are optional, and stop
+     at the end of the line. */
+  do c = getc(f); while (c == ' ' || c == '\t');
+  if (c != EOF) ungetc(c, f);
+  if (c != '\n' && c != EOF &&
+      fscanf(f, "%ld", &dy_data->solutions) != 1) {
+    ps_dynamic_clear(dy_data);
+    return(NULL);
+  }
+  do c = getc(f); while (c == ' ' || c == '\t');
+  if (c != EOF) ungetc(c, f);
+  if (c != '\n' && c != EOF)
+    for (i=0; i<=2*d+1; i++)
+      if (!fmpz_fread(f, dy_data->wrap_lo+i)) {
+	ps_dynamic_clear(dy_data);
+	return(NULL);
+      }
+
+  /* Recompute the power sums from pol, as in set_range_from_power_sums. */
+  lead_pow = _fmpz_vec_init(d+1);
+  fmpz_one(lead_pow);
+  for (i=1; i<=d; i++)
+    fmpz_mul(lead_pow+i, lead_pow+i-1, dy_data->pol+d);
+  for (k=1; k<=d; k++)
+    ps_power_sum(dy_data->sum_col, dy_data->pol, lead_pow, d, k, dy_data->w);
+  _fmpz_vec_clear(lead_pow, d+1);
+  return(dy_data);
+}
+
+/* Wrappers for the Sturm tests, which try the word-size versions first
+   if the coefficients are small enough. {ws, 4*n} is word scratch space. */
+int all_roots_in_interval(fmpz *poly, slong n, fmpz *a, fmpz *b,
+			  fmpz *w, slong *ws) {
+  slong i;
+  int r = ROOTS_OVERFLOW;
+  if (n*FLINT_ABS(_fmpz_vec_max_bits(poly, n)) <= SI_STURM_BITS) {
+    for (i=0; i<n; i++) ws[i] = fmpz_get_si(poly+i);
+    r = _si_poly_all_roots_in_interval(ws, n, fmpz_get_si(a), fmpz_get_si(b),
+				       ws+n);
+  }
+  if (r == ROOTS_OVERFLOW)
+    r = _fmpz_poly_all_roots_in_interval(poly, n, a, b, w);
+  return(r);
+}
+
+int all_roots_real(fmpz *poly, slong n, fmpz *w, slong *ws) {
+  slong i;
+  int r = ROOTS_OVERFLOW;
+  if (n*FLINT_ABS(_fmpz_vec_max_bits(poly, n)) <= SI_STURM_BITS) {
+    for (i=0; i<n; i++) ws[i] = fmpz_get_si(poly+i);
+    r = _si_poly_all_roots_real(ws, n, ws+n);
+  }
+  if (r == ROOTS_OVERFLOW)
+    r = _fmpz_poly_all_roots_real(poly, n, w);
+  return(r);
+}
+
+/* Sibling-parametric Sturm test, used by set_range_from_power_sums at
+   level n (for n >= 1 and modulus != 0) if st_data->sturm_bisect is set.
+
+   The candidates for pol[n-1] are t_i = pol[n-1] + (lower+i)*modulus for
+   0 <= i < cnt = upper-lower+1. Each child tests whether the divided
+   (n-1)-st derivative of pol, i.e., h_t = G + t with G = h_0, has only real
+   roots; as G' is fixed, the set of admissible t is an interval [lo, hi].
+   Instead of stepping through it, we locate it by bisection with the Sturm
+   test, then tighten lower and upper and mark the level in sturm_ok, so
+   that the children skip the test.
+
+   To find a first admissible value, we use the Tarski query
+      TaQ(t) = sum of sign(G(c) + t) over the distinct roots c of G',
+   computed as a Cauchy index. It is nondecreasing in t; if G' has
+   distinct roots, it equals -(K%2) (where K is the length of G) for t
+   in the interior of [lo, hi], and is smaller (resp. larger) for t < lo
+   (resp. t > hi). It is only used to choose where to look: admissibility
+   is always decided by the Sturm test itself.
+
+   This only pays off when there are enough siblings; below
+   STURM_BISECT_MIN candidates, we leave the test to the children.
+
+   Return values:
+     1: if lower and upper have been tightened
+     2: if the interval was left alone
+     0, r <= -2: if no candidate is admissible; set_range_from_power_sums
+       returns this value, which skips the children as next_pol would
+       if it had visited them.
+*/
+#define STURM_BISECT_MIN 8
+
+int sturm_bisect(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		 fmpz *lower, fmpz *upper) {
+  int d = st_data->d;
+  int n = dy_data->n;
+  slong K = d+2-n;
+  fmpz *modulus = st_data->modlist + n-1;
+  fmpz *pol = dy_data->pol;
+  slong i, cnt, s, ok, bad, step, target;
+  int r;
+
+  /* Allocate temporary variables from persistent scratch space. */
+  fmpz *G = dy_data->wp;
+  fmpz *P = dy_data->wp + d+1;
+  fmpz *V = dy_data->wp + 2*d+2;
+  fmpz *U = dy_data->wp + 3*d+3;
+  fmpz *R = dy_data->wp + 4*d+4;
+  fmpz *w = dy_data->wp + 5*d+5; /* 3*d+11 */
+  fmpz *t0z = dy_data->wp + 8*d+16;
+  fmpz *t1z = dy_data->wp + 8*d+17;
+
+  /* Set G[0] to t_i. */
+  void set_t(slong i) {
+    fmpz_set_si(t0z, i);
+    fmpz_add(t0z, t0z, lower);
+    fmpz_mul(t0z, t0z, modulus);
+    fmpz_add(G, pol+n-1, t0z);
+  }
+
+  int sturm(slong i) {
+    int r;
+    set_t(i);
+    PS_TIMED(dy_data, n, real_cycles,
+	     r = all_roots_real(G, K, w, dy_data->ws));
+    return(r);
+  }
+
+  slong taq(slong i) {
+    set_t(i);
+    _fmpz_vec_scalar_mul_fmpz(R, V, K-2, G);
+    _fmpz_vec_add(R, R, U, K-2);
+    return(_fmpz_poly_cauchy_index(P, K-1, R, K-2, w));
+  }
+
+  fmpz_sub(t0z, upper, lower);
+  if (!fmpz_fits_si(t0z)) return(2);
+  cnt = fmpz_get_si(t0z) + 1;
+  if (cnt < STURM_BISECT_MIN) return(2);
+  if (K <= 2) return(2); /* G is linear */
+
+  for (i=1; i<K; i++)
+    fmpz_mul(G+i, fmpz_mat_entry(st_data->binom_mat, n-1+i, n-1), pol+n-1+i);
+
+  r = sturm(0);
+  /* A failure independent of t applies to all candidates. */
+  if (r < 0) return((r < -1) ? r : 0);
+  if (r == 1) s = 0;
+  else {
+    /* P = G', V = lc(P)^(K-1) * P', U = lc(P)^(K-1) * P' * G mod P,
+       so that U + t*V is a positive multiple of P' * (G+t) mod P. */
+    fmpz_zero(G);
+    _fmpz_poly_derivative(P, G, K);
+    _fmpz_poly_derivative(V, P, K-1);
+    _fmpz_poly_mul(w, G, K, V, K-2);
+    _fmpz_poly_prem_inplace(w, 2*K-3, P, K-1);
+    _fmpz_vec_set(U, w, K-2);
+    fmpz_pow_ui(t1z, P+K-2, K-1);
+    _fmpz_vec_scalar_mul_fmpz(V, V, K-2, t1z);
+
+    s = -1;
+    if (_fmpz_poly_cauchy_index(P, K-1, V, K-2, w) == K-2) {
+      /* G' has distinct roots: find the first i with TaQ(t_i) >= target. */
+      target = -(K%2);
+      ok = cnt;
+      bad = 0;
+      while (ok - bad > 1) {
+	i = (ok+bad)/2;
+	if (taq(i) >= target) ok = i;
+	else bad = i;
+      }
+      /* Either t_ok is interior, or the only candidates left are the
+         endpoints t_{ok-1} = lo and t_ok = hi. */
+      if (ok < cnt && taq(ok) == target) {
+	if (sturm(ok) == 1) s = ok;
+      } else {
+	if (ok < cnt && sturm(ok) == 1) s = ok;
+	else if (ok-1 > 0 && sturm(ok-1) == 1) s = ok-1;
+	else return(0);
+      }
+    }
+    /* Otherwise, fall back to a linear search. */
+    if (s < 0) {
+      for (i=1; i<cnt; i++)
+	if (sturm(i) == 1) break;
+      if (i == cnt) return(0);
+      s = i;
+    }
+  }
+
+  /* Find the ends of the interval by galloping from s, then bisecting. */
+  ok = s;
+  bad = (s == 0) ? -1 : 0;
+  for (step=1; ok-step > bad; step *= 2) {
+    if (sturm(ok-step) != 1) { bad = ok-step; break; }
+    ok -= step;
+  }
+  while (ok - bad > 1) {
+    i = (ok+bad)/2;
+    if (sturm(i) == 1) ok = i;
+    else bad = i;
+  }
+  fmpz_set_si(t1z, ok);
+  fmpz_add(t1z, t1z, lower);
+
+  ok = s;
+  bad = cnt;
+  for (step=1; ok+step < bad; step *= 2) {
+    if (sturm(ok+step) != 1) { bad = ok+step; break; }
+    ok += step;
+  }
+  while (bad - ok > 1) {
+    i = (ok+bad)/2;
+    if (sturm(i) == 1) ok = i;
+    else bad = i;
+  }
+  fmpz_set_si(t0z, ok);
+  fmpz_add(upper, lower, t0z);
+  fmpz_set(lower, t1z);
+  return(1);
+}
+
+void ps_static_set_sturm_bisect(ps_static_data_t *st_data, int flag) {
+  st_data->sturm_bisect = flag;
+}
+
+/* Extend a fraction-free LDL^T factorization of a symmetric matrix A,
+   stored in the rows of L (with stride m), by row r. On entry, w holds
+   A[r][0], ..., A[r][r]; the pivots L[p][p] (p < r) must be nonzero.
+   On exit, L[r][p] (p < r) is the entry of row r after p steps of
+   Bareiss elimination, and w[r] the determinant of the leading 
+   (r+1)x(r+1) submatrix of A. */
+void _fmpz_ldl_extend(fmpz *L, slong m, slong r, fmpz *w) {
+  slong p, j;
+  for (p=0; p<r; p++) {
+    fmpz_set(L+r*m+p, w+p);
+    for (j=p+1; j<=r; j++) {
+      fmpz_mul(w+j, w+j, L+p*m+p);
+      fmpz_submul(w+j, w+p, L+j*m+p);
+      if (p > 0) fmpz_divexact(w+j, w+j, L+(p-1)*m+p-1);
+    }
+  }
+}
+
+/* Hankel positivity test, used by set_range_from_power_sums at even
+   levels k = 2r if st_data->hankel is set.
+
+   If the roots lie in [-2 sqrt(q), 2 sqrt(q)], the matrices
+     H = (s_{i+j})_{i,j >= 0} and M = (4q s_{i+j} - s_{i+j+2})_{i,j >= 0}
+   (truncated to the power sums known so far) are positive semidefinite,
+   as are their versions with s_j scaled by lead^j, which are conjugate
+   to them by diagonal matrices. The new power sum s_k appears first as
+   the bottom right entry of H_r and M_{r-1} (the leading (r+1)x(r+1)
+   and rxr submatrices); their determinants are linear in that entry,
+   with coefficient the previous leading minor, so they give an upper
+   and a lower bound on the current coefficient.
+
+   We keep fraction-free LDL^T factorizations of H and M, extended here
+   by one row per even level, so that the cost is O(r^2) per node. Each
+   new row is computed with a zero bottom right entry; the resulting
+   determinant is kept in c, and the pivot is completed at the next even
+   level, once s_k is fixed. If a pivot vanishes (which requires roots
+   to be repeated or at the ends of the interval), we stop extending. 
+
+   Return 1 if the rows for level k have been computed, and set b so
+   that the bounds are f*i <= b[0]/b[1] and f*i >= b[2]/b[3], where
+   i is the offset from the current value of the coefficient, as in
+   set_range_from_power_sums. Otherwise return 0. */
+int hankel_extend(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		  fmpz *b) {
+  int d = st_data->d;
+  int k = d+1-dy_data->n;
+  int r = k/2, m = d/2+1, j;
+  fmpz *sum_col = dy_data->sum_col;
+  fmpz *HL = dy_data->hk;
+  fmpz *Hc = HL + m*m;
+  fmpz *ML = Hc + m;
+  fmpz *Mc = ML + m*m;
+  fmpz *w = Mc + m;
+
+  if (dy_data->hk_n < r) return(0);
+  dy_data->hk_n = r;
+
+  /* Complete the pivots of H_{r-1} and M_{r-2}. */
+  fmpz_set(HL+(r-1)*m+r-1, Hc+r-1);
+  if (r == 1) fmpz_add(HL, HL, sum_col);
+  else fmpz_addmul(HL+(r-1)*m+r-1, HL+(r-2)*m+r-2, sum_col+k-2);
+  if (fmpz_sgn(HL+(r-1)*m+r-1) <= 0) return(0);
+  if (r >= 2) {
+    fmpz_mul_si(w, st_data->lead_pow+2, 4*st_data->q);
+    fmpz_mul(w, w, sum_col+k-4);
+    fmpz_sub(w, w, sum_col+k-2);
+    fmpz_set(ML+(r-2)*m+r-2, Mc+r-2);
+    if (r == 2) fmpz_add(ML, ML, w);
+    else fmpz_addmul(ML+(r-2)*m+r-2, ML+(r-3)*m+r-3, w);
+    if (fmpz_sgn(ML+(r-2)*m+r-2) <= 0) return(0);
+  }
+
+  /* Add row r to H and row r-1 to M. */
+  for (j=0; j<r; j++) fmpz_set(w+j, sum_col+r+j);
+  fmpz_zero(w+r);
+  _fmpz_ldl_extend(HL, m, r, w);
+  fmpz_set(Hc+r, w+r);
+  for (j=0; j<r-1; j++) {
+    fmpz_mul_si(w+j, st_data->lead_pow+2, 4*st_data->q);
+    fmpz_mul(w+j, w+j, sum_col+r-1+j);
+    fmpz_sub(w+j, w+j, sum_col+r+1+j);
+  }
+  fmpz_zero(w+r-1);
+  _fmpz_ldl_extend(ML, m, r-1, w);
+  fmpz_set(Mc+r-1, w+r-1);
+  dy_data->hk_n = r+1;
+
+  /* The determinants of H_r and M_{r-1} at the current value of s_k. */
+  fmpz_set(b, Hc+r);
+  fmpz_addmul(b, HL+(r-1)*m+r-1, sum_col+k);
+  fmpz_set(b+1, HL+(r-1)*m+r-1);
+  fmpz_mul_si(w, st_data->lead_pow+2, 4*st_data->q);
+  fmpz_mul(w, w, sum_col+k-2);
+  fmpz_sub(w, w, sum_col+k);
+  fmpz_neg(b+2, Mc+r-1);
+  if (r == 1) fmpz_sub(b+2, b+2, w);
+  else fmpz_submul(b+2, ML+(r-2)*m+r-2, w);
+  if (r == 1) fmpz_one(b+3);
+  else fmpz_set(b+3, ML+(r-2)*m+r-2);
+  return(1);
+}
+
+void ps_static_set_hankel(ps_static_data_t *st_data, int flag) {
+  st_data->hankel = flag;
+}
+
+/* Recompute the Hankel factorizations of a state read back with
+   ps_dynamic_fread, which only restores the power sums, as they were
+   when it was written: the rows for the levels above the one at which
+   it resumes. Without this, the resumed search still finds the same
+   solutions, but without the Hankel bounds. */
+void ps_dynamic_restore(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data) {
+  int d = st_data->d, n = dy_data->n, r, k;
+
+  if (!st_data->hankel) return;
+  k = d+1 - (dy_data->ascend ? n+1 : n);
+  dy_data->hk_n = 1;
+  for (r=1; 2*r < k; r++) {
+    dy_data->n = d+1-2*r;
+    if (!hankel_extend(st_data, dy_data, dy_data->w + 3*d + 16)) break;
+  }
+  dy_data->n = n;
+}
+
+void ps_static_set_filter(ps_static_data_t *st_data, int flags) {
+  st_data->filter = flags;
+}
+
+/* In count-only mode, next_pol does not return the solutions, but only
+   counts them in dy_data->solutions (see extract_solutions). */
+void ps_static_set_count_only(ps_static_data_t *st_data, int flag) {
+  st_data->count_only = flag;
+}
+
+/* With PS_ORDER_CENTER, next_pol visits the values of each coefficient
+   starting from the middle of their range: first those from there up,
+   then those below (see ps_wrap_center). This tends to reach the first
+   solutions sooner. The solutions are the same, but not the tree: an
+   early abort only rules out the values above the current one (see
+   ps_wrap_skip), so those below the middle are still visited where the
+   increasing order would have skipped them, and the node count can
+   differ. It is ignored in count-only mode and when newton_advance is
+   in use, which only moves upwards. */
+void ps_static_set_order(ps_static_data_t *st_data, int order) {
+  st_data->order = order;
+}
+
+/* Start the values of pol[n], just set by set_range_from_power_sums,
+   from the middle of their range, and leave the lower half pending in
+   wrap_lo[n] and wrap_hi[n]. */
+static void ps_wrap_center(ps_static_data_t *st_data,
+			   ps_dynamic_data_t *dy_data, int n) {
+  int d = st_data->d;
+  fmpz *pol = dy_data->pol;
+  fmpz *modulus = st_data->modlist+n;
+  fmpz *t = dy_data->w;
+
+  fmpz_one(dy_data->wrap_lo+n);
+  fmpz_zero(dy_data->wrap_hi+n);
+  if (fmpz_is_zero(modulus)) return;
+  fmpz_sub(t, dy_data->upper+n, pol+n);
+  fmpz_fdiv_q(t, t, modulus);
+  fmpz_add_ui(t, t, 1);
+  fmpz_fdiv_q_2exp(t, t, 1);
+  if (fmpz_is_zero(t)) return;
+  fmpz_set(dy_data->wrap_lo+n, pol+n);
+  fmpz_addmul(pol+n, t, modulus);
+  fmpz_sub(dy_data->wrap_hi+n, pol+n, modulus);
+  fmpz_submul(dy_data->sum_col+d-n, t, st_data->f+n);
+}
+
+static int ps_wrap_pending(ps_dynamic_data_t *dy_data, int n) {
+  return(fmpz_cmp(dy_data->wrap_lo+n, dy_data->wrap_hi+n) <= 0);
+}
+
+/* Move on to the values of pol[n] left pending by ps_wrap_center. The
+   (d-n)-th power sum must be that of the current value of pol[n]. */
+static void ps_wrap_next(ps_static_data_t *st_data,
+			 ps_dynamic_data_t *dy_data, int n) {
+  int d = st_data->d;
+  fmpz *pol = dy_data->pol;
+  fmpz *t = dy_data->w;
+
+  fmpz_sub(t, pol+n, dy_data->wrap_lo+n);
+  fmpz_divexact(t, t, st_data->modlist+n);
+  fmpz_addmul(dy_data->sum_col+d-n, t, st_data->f+n);
+  fmpz_set(pol+n, dy_data->wrap_lo+n);
+  fmpz_set(dy_data->upper+n, dy_data->wrap_hi+n);
+  fmpz_one(dy_data->wrap_lo+n);
+  fmpz_zero(dy_data->wrap_hi+n);
+  /* The early abort in next_pol assumes that the previous value of
+     pol[n] succeeded; this is not so for the first pending value. */
+  dy_data->n = n+1;
+}
+
+/* The early aborts in next_pol only rule out the values of pol[n] above
+   the current one; return ascend, or 0 after moving on to the values
+   below left pending by ps_wrap_center, if any. */
+static int ps_wrap_skip(ps_static_data_t *st_data,
+			ps_dynamic_data_t *dy_data, int n, int ascend) {
+  if (!ps_wrap_pending(dy_data, n)) return(ascend);
+  ps_wrap_next(st_data, dy_data, n);
+  return(0);
+}
+
+int moebius_mu(int n) {
+  int p, r = 1;
+  for (p=2; p*p<=n; p++)
+    if (n%p == 0) {
+      n /= p;
+      if (n%p == 0) return(0);
+      r = -r;
+    }
+  return((n > 1) ? -r : r);
+}
+
+/* Point count constraint, used by set_range_from_power_sums if 
+   st_data->point_count is set to (p, e0, e1, e2, sign, w).
+
+   The polynomial is taken to be the zeta function numerator of a variety
+   over F_p with
+     N_k = e0 + e1 p^k + e2 p^(2k) + sign p^(wk) t_k
+   points over F_{p^k}, where t_k is the sum of the k-th powers of the 
+   reciprocal roots (including those of the cofactor). The number of
+   closed points of degree k, namely (1/k) sum_{j|k} mu(k/j) N_j, must
+   be nonnegative; at level k, this is linear in s_k.
+
+   Set V to lead^k sum_{j|k} mu(k/j) N_j, at the current value of s_k.
+   The trace t_j is read off from row 0 of sum_mats[j]. */
+void point_count_value(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		       fmpz_t V, fmpz_t t) {
+  int d = st_data->d;
+  int k = d+1-dy_data->n;
+  int i, j, mu;
+
+  fmpz_zero(V);
+  for (j=1; j<=k; j++) {
+    if (k%j != 0 || (mu = moebius_mu(k/j)) == 0) continue;
+    fmpz_zero(t);
+    for (i=0; i<=j; i++)
+      fmpz_addmul(t, fmpz_mat_entry(st_data->sum_mats[j], 0, i),
+		  dy_data->sum_col+i);
+    fmpz_mul(t, t, st_data->count_b+j);
+    fmpz_add(t, t, st_data->count_a+j);
+    fmpz_mul(t, t, st_data->lead_pow+k-j);
+    if (mu > 0) fmpz_add(V, V, t);
+    else fmpz_sub(V, V, t);
+  }
+}
+
+/* Newton polygon constraint, used if st_data->newton is set to 
+   (p, lo_1, ..., lo_d, hi_1, ..., hi_d), with -1 meaning no bound.
+
+   Write sympol (without the cofactor) as sign (a_0 + a_1 x + ... ), so
+   that a_0 = lead. The constraint is lo_k <= v_p(a_k/a_0) <= hi_k for 
+   1 <= k <= d. Since the Newton polygon is the lower convex hull of the
+   points (k, v_p(a_k)), this can express lower bounds on the polygon as
+   well as the p-rank, which is the largest k with v_p(a_k/a_0) = 0.
+   As a_k only depends on pol[d-k], ..., pol[d], it is checked when 
+   pol[d-k] is chosen, at level k.
+
+   Move pol[m] forward by a multiple of modlist[m], updating the power 
+   sum, to the first value satisfying the constraint at level d-m.
+   Return 0 if there is no such value up to upper[m]. If modlist[m] is
+   zero, only check the current value. */
+int newton_advance(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		   int m) {
+  int d = st_data->d, k = d-m;
+  int i, r = 1;
+  fmpz *pol = dy_data->pol;
+  fmpz *modulus = st_data->modlist+m;
+  fmpz *lo = st_data->newton_lo+k, *hi = st_data->newton_hi+k;
+  fmpz_t a, g, j, step;
+
+  fmpz_init(a);
+  fmpz_init(g);
+  fmpz_init(j);
+  fmpz_init(step);
+  for (i=0; i<=k; i++)
+    fmpz_addmul(a, fmpz_mat_entry(st_data->newton_mat, k, i), pol+d-i);
+
+  /* Find the least j >= 0 with a + j*modulus divisible by lo; the 
+     solutions then step by lo/gcd(modulus, lo). */
+  fmpz_gcd(g, modulus, lo);
+  if (!fmpz_divisible(a, g)) r = 0;
+  else {
+    fmpz_divexact(step, lo, g);
+    if (!fmpz_is_one(step)) {
+      fmpz_divexact(j, modulus, g);
+      fmpz_invmod(j, j, step);
+      fmpz_divexact(g, a, g);
+      fmpz_mul(j, j, g);
+      fmpz_neg(j, j);
+      fmpz_mod(j, j, step);
+    }
+    fmpz_addmul(a, j, modulus);
+  }
+
+  /* Skip the values divisible by hi. Consecutive ones cannot both be 
+     divisible unless all of them are. */
+  if (r && !fmpz_is_zero(hi) && fmpz_divisible(a, hi)) {
+    fmpz_mul(g, step, modulus);
+    if (fmpz_divisible(g, hi)) r = 0;
+    else fmpz_add(j, j, step);
+  }
+
+  if (r && !fmpz_is_zero(j)) {
+    if (fmpz_is_zero(modulus)) r = 0;
+    else {
+      fmpz_addmul(pol+m, j, modulus);
+      fmpz_submul(dy_data->sum_col+k, j, st_data->f+m);
+      r = (fmpz_cmp(pol+m, dy_data->upper+m) <= 0);
+    }
+  }
+  fmpz_clear(a);
+  fmpz_clear(g);
+  fmpz_clear(j);
+  fmpz_clear(step);
+  return(r);
 }
 
 /* Return values: 
@@ -395,14 +1501,17 @@ void ps_dynamic_clear(ps_dynamic_data_t *dy_data) {
 */
 int set_range_from_power_sums(ps_static_data_t *st_data,
 			  ps_dynamic_data_t *dy_data) {
-  int i, j, r, r1, r2, s;
+  int i, j, r;
   int d = st_data->d;
   int n = dy_data->n;
   int k = d+1-n;
   int q = st_data->q;
   fmpz *modulus = st_data->modlist + n-1;
   fmpz *pol = dy_data->pol;
-  fmpq *f;
+  fmpz *lead_pow = st_data->lead_pow;
+  fmpz *sum_col = dy_data->sum_col;
+  fmpz *sum_prod = dy_data->sum_prod;
+  fmpz *f;
     
   /* Allocate temporary variables from persistent scratch space. */
   fmpz *tpol = dy_data->w;
@@ -414,76 +1523,74 @@ int set_range_from_power_sums(ps_static_data_t *st_data,
   fmpz *t2z = dy_data->w + 3*d + 5;
   fmpz *lower = dy_data->w + 3*d + 6;
   fmpz *upper = dy_data->w + 3*d + 7;
-  
-  fmpq *t0q = dy_data->w2;
-  fmpq *t1q = dy_data->w2 + 1;
-  fmpq *t2q = dy_data->w2 + 2;
-  fmpq *t3q = dy_data->w2 + 3;
-  fmpq *t4q = dy_data->w2 + 4;
+  fmpz *t3z = dy_data->w + 3*d + 8;
+  fmpz *t4z = dy_data->w + 3*d + 9;
+  fmpz *s0z = dy_data->w + 3*d + 10;
+  fmpz *s1z = dy_data->w + 3*d + 11;
+  fmpz *u = dy_data->w + 3*d + 12; /* 4 entries */
+  fmpz *hkb = dy_data->w + 3*d + 16; /* 4 entries */
+  int hk = 0;
+#ifdef PS_STATS
+  long bound_t0;
+#endif
 
   /* Subroutines to adjust lower and upper bounds. 
-   These use t0q and t4q as persistent scratch space. */
+     Since the power sums are scaled by lead^k, so is every bound; 
+     the bound is val/f, or val/den (den > 0) for the change_* variants.
+     These use s0z and s1z as persistent scratch space. */
 
-  void set_lower(const fmpq_t val) {
-    fmpq_div(t0q, val, f);
-    fmpq_ceil(lower, t0q);
+  void set_lower(const fmpz_t val) {
+    fmpz_cdiv_q(lower, val, f);
   }
   
-  void set_upper(const fmpq_t val) {
-    fmpq_div(t0q, val, f);
-    fmpq_floor(upper, t0q);
+  void set_upper(const fmpz_t val) {
+    fmpz_fdiv_q(upper, val, f);
   }
 
-  void set_lower_quad(const fmpq_t val1, const fmpq_t val2) {
-    fmpq_div(t0q, val1, f);
-    if (val2==NULL) fmpq_ceil(lower, t0q);
-    else {
-      fmpq_div(t4q, val2, f);
-      fmpq_ceil_quad(lower, t0q, t4q, q);
-    }
+  void set_lower_quad(const fmpz_t val1, const fmpz_t val2) {
+    fmpz_cdiv_quad(lower, val1, val2, f, q, s1z);
   }
   
-  void set_upper_quad(const fmpq_t val1, const fmpq_t val2) {
-    fmpq_div(t0q, val1, f);
-    if (val2==NULL) fmpq_floor(upper, t0q);
-    else {
-      fmpq_div(t4q, val2, f);
-      fmpq_floor_quad(upper, t0q, t4q, q);
-    }
+  void set_upper_quad(const fmpz_t val1, const fmpz_t val2) {
+    fmpz_fdiv_quad(upper, val1, val2, f, q, s1z);
   }
 
-  void change_lower(const fmpq_t val) {
-    fmpq_div(t0q, val, f);
-    fmpq_ceil(t0z, t0q);
-    if (fmpz_cmp(t0z, lower) > 0) fmpz_set(lower, t0z);
+  void change_lower(const fmpz_t val, const fmpz_t den) {
+    fmpz_cdiv_q(s0z, val, den);
+    if (fmpz_cmp(s0z, lower) > 0) fmpz_set(lower, s0z);
   }
   
-  void change_upper(const fmpq_t val) {
-    fmpq_div(t0q, val, f);
-    fmpq_floor(t0z, t0q);
-    if (fmpz_cmp(t0z, upper) < 0) fmpz_set(upper, t0z);
+  void change_upper(const fmpz_t val, const fmpz_t den) {
+    fmpz_fdiv_q(s0z, val, den);
+    if (fmpz_cmp(s0z, upper) < 0) fmpz_set(upper, s0z);
   }
     
-  void change_lower_quad(const fmpq_t val1, const fmpq_t val2) {
-    fmpq_div(t0q, val1, f);
-    if (val2==NULL) fmpq_ceil(t0z, t0q);
-    else {
-      fmpq_div(t4q, val2, f);
-      fmpq_ceil_quad(t0z, t0q, t4q, q);
-    }
-    if (fmpz_cmp(t0z, lower) > 0) fmpz_set(lower, t0z);
+  void change_lower_quad(const fmpz_t val1, const fmpz_t val2) {
+    fmpz_cdiv_quad(s0z, val1, val2, f, q, s1z);
+    if (fmpz_cmp(s0z, lower) > 0) fmpz_set(lower, s0z);
   }
   
-  void change_upper_quad(const fmpq_t val1, const fmpq_t val2) {
-    fmpq_div(t0q, val1, f);
-    if (val2==NULL) fmpq_floor(t0z, t0q);
-    else {
-      fmpq_div(t4q, val2, f);
-      fmpq_floor_quad(t0z, t0q, t4q, q);
-    }
-    if (fmpz_cmp(t0z, upper) < 0) fmpz_set(upper, t0z);
+  void change_upper_quad(const fmpz_t val1, const fmpz_t val2) {
+    fmpz_fdiv_quad(s0z, val1, val2, f, q, s1z);
+    if (fmpz_cmp(s0z, upper) < 0) fmpz_set(upper, s0z);
+  }
+
+  /* The bound is (val1 + val2 sqrt(q))/(den1 + den2 sqrt(q))/f, 
+     where den1 + den2 sqrt(q) > 0. These also use u as scratch space. */
+  void change_lower_ratio(const fmpz_t val1, const fmpz_t val2,
+			  const fmpz_t den1, const fmpz_t den2) {
+    fmpz_cdiv_quad_ratio(s0z, val1, val2, den1, den2, f, q, u);
+    if (fmpz_cmp(s0z, lower) > 0) fmpz_set(lower, s0z);
+  }
+
+  void change_upper_ratio(const fmpz_t val1, const fmpz_t val2,
+			  const fmpz_t den1, const fmpz_t den2) {
+    fmpz_fdiv_quad_ratio(s0z, val1, val2, den1, den2, f, q, u);
+    if (fmpz_cmp(s0z, upper) < 0) fmpz_set(upper, s0z);
   }
     
+  PS_STAT(dy_data, n, nodes, 1);
+
   /* Compute the divided n-th derivative of pol. */
   for (i=0; i<=k-1; i++)
     fmpz_mul(tpol+i, fmpz_mat_entry(st_data->binom_mat, n+i, n), pol+n+i);
@@ -496,73 +1603,101 @@ int set_range_from_power_sums(ps_static_data_t *st_data,
       _fmpz_poly_mul(tpol+2*k, tpol, k, tpol+k, k);
       for (i=0; i<=k-1; i++) fmpz_set(tpol+i, tpol+2*k+2*i);
     }
-    r = _fmpz_poly_all_roots_in_interval(tpol, k, st_data->a, st_data->b, dy_data->w+d+1);
-    if (r<=0) return(r-1);
+    PS_TIMED(dy_data, n, interval_cycles,
+	     r = all_roots_in_interval(tpol, k, st_data->a, st_data->b,
+				       dy_data->w+d+1, dy_data->ws));
+    if (r<=0) {
+      PS_STAT(dy_data, n, sturm_fail, 1);
+      return(r-1);
+    }
     /* Restore tpol. */
     for (i=0; i<=k-1; i++)
       fmpz_mul(tpol+i, fmpz_mat_entry(st_data->binom_mat, n+i, n), pol+n+i);
   } else {
-    /* Only check for real roots; we'll deal with the interval later. */
-    r = _fmpz_poly_all_roots_real(tpol, k, dy_data->w+d+1);
-    if (r<=0) return(r-1);
+    /* Only check for real roots; we'll deal with the interval later.
+       This was already done for all siblings if sturm_ok[n] is set. */
+    if (!dy_data->sturm_ok[n]) {
+      PS_TIMED(dy_data, n, real_cycles,
+	       r = all_roots_real(tpol, k, dy_data->w+d+1, dy_data->ws));
+      if (r<=0) {
+	PS_STAT(dy_data, n, sturm_fail, 1);
+	return(r-1);
+      }
+    }
   }
   
   /* If r=1 and k>d, no further coefficients to bound. */
   if (k>d) return(1);
 
+#ifdef PS_STATS
+  bound_t0 = PS_CYCLES();
+#endif
   /* Compute the k-th power sum. */
-  f = fmpq_mat_entry(dy_data->sum_col, k, 0);
-  fmpq_set_si(f, -k, 1);
-  fmpq_mul_fmpz(f, f, pol+d-k);
-  fmpq_div_fmpz(f, f, pol+d);
-  for (i=1; i<k; i++) {
-    fmpq_set_fmpz_frac(t0q, pol+d-i, pol+d);
-    fmpq_neg(t0q, t0q);
-    fmpq_addmul(f, t0q, fmpq_mat_entry(dy_data->sum_col, k-i, 0));
-  }
+  ps_power_sum(sum_col, pol, lead_pow, d, k, t0z);
+  if (st_data->hankel && k%2==0)
+    hk = hankel_extend(st_data, dy_data, hkb);
   
-  /* If modulus==0, no further work required. */
+  /* If modulus==0, no further work required,
+     except for checking the point count constraint. */
   if (fmpz_is_zero(modulus)) {
+    PS_STAT(dy_data, n, bound_cycles, PS_CYCLES() - bound_t0);
+    if (st_data->point_count != NULL) {
+      point_count_value(st_data, dy_data, t0z, t4z);
+      if (fmpz_sgn(t0z) < 0) {
+	PS_STAT(dy_data, n, empty, 1);
+	return(0);
+      }
+    }
+    if (st_data->newton != NULL && !newton_advance(st_data, dy_data, n-1)) {
+      PS_STAT(dy_data, n, empty, 1);
+      return(0);
+    }
+    PS_STAT(dy_data, n, width, 1);
     fmpz_zero(lower);
     fmpz_zero(upper);
     return(1);
   }
 
-  /* Initialize bounds using asymmetrized power sums. */
+  /* Initialize bounds using asymmetrized power sums. 
+     Only the first k+1 power sums enter. */
   f = st_data->f + n-1;
-  fmpq_mat_mul(dy_data->sum_prod, st_data->sum_mats[k], dy_data->sum_col);
+  for (r=0; r<9; r++) {
+    fmpz_zero(sum_prod+r);
+    for (j=0; j<=k; j++)
+      fmpz_addmul(sum_prod+r, fmpz_mat_entry(st_data->sum_mats[k], r, j),
+		  sum_col+j);
+  }
   
   if (q == 1) {
-    fmpq_set_si(t1q, 2*d, 1);
-    fmpq_sub(t0q, fmpq_mat_entry(dy_data->sum_prod, 0, 0), t1q);
-    set_lower(t0q);
-    fmpq_add(t0q, fmpq_mat_entry(dy_data->sum_prod, 0, 0), t1q);
-    set_upper(t0q);
+    fmpz_mul_si(t1z, lead_pow+k, 2*d);
+    fmpz_sub(t0z, sum_prod, t1z);
+    set_lower(t0z);
+    fmpz_add(t0z, sum_prod, t1z);
+    set_upper(t0z);
   }
   else if (k%2==0) {
-    fmpq_set_si(t1q, 2*d, 1);
-    fmpz_set_si(t0z, q);
-    fmpz_pow_ui(t0z, t0z, k/2);
-    fmpq_mul_fmpz(t1q, t1q, t0z);
-    fmpq_sub(t0q, fmpq_mat_entry(dy_data->sum_prod, 0, 0), t1q);
-    set_lower(t0q);
-    fmpq_add(t0q, fmpq_mat_entry(dy_data->sum_prod, 0, 0), t1q);
-    set_upper(t0q);
+    fmpz_set_si(t1z, q);
+    fmpz_pow_ui(t1z, t1z, k/2);
+    fmpz_mul_si(t1z, t1z, 2*d);
+    fmpz_mul(t1z, t1z, lead_pow+k);
+    fmpz_sub(t0z, sum_prod, t1z);
+    set_lower(t0z);
+    fmpz_add(t0z, sum_prod, t1z);
+    set_upper(t0z);
   } else {
-    fmpq_zero(t1q); 
-    fmpq_set_si(t2q, 2*d, 1);
-    fmpz_set_si(t0z, q);
-    fmpz_pow_ui(t0z, t0z, k/2);
-    fmpq_mul_fmpz(t2q, t2q, t0z);
-    set_upper_quad(fmpq_mat_entry(dy_data->sum_prod, 0, 0), t2q);
-    fmpq_neg(t2q, t2q);
-    set_lower_quad(fmpq_mat_entry(dy_data->sum_prod, 0, 0), t2q);
+    fmpz_set_si(t2z, q);
+    fmpz_pow_ui(t2z, t2z, k/2);
+    fmpz_mul_si(t2z, t2z, 2*d);
+    fmpz_mul(t2z, t2z, lead_pow+k);
+    set_upper_quad(sum_prod, t2z);
+    fmpz_neg(t2z, t2z);
+    set_lower_quad(sum_prod, t2z);
   }
 
   /* Apply Descartes' rule of signs at -2*sqrt(q), +2*sqrt(q);
-     this enforces the roots being in the correct interval (if real). */
-  fmpq_set_si(t3q, -k, 1);
-  fmpq_div_fmpz(t3q, t3q, pol+d);
+     this enforces the roots being in the correct interval (if real). 
+     Here t3z = -k*lead^(k-1), the scaled counterpart of -k/lead. */
+  fmpz_mul_si(t3z, lead_pow+k-1, -k);
 
   /* Currently tpol is the divided n-th derivative of pol.
      Undo one derivative, then evaluate at the endpoints. */
@@ -573,30 +1708,14 @@ int set_range_from_power_sums(ps_static_data_t *st_data,
   fmpz_set(tpol, pol+d-k);
 
   if (q == 1) {
-    /*
-    _fmpz_poly_evaluate_fmpz(t0z, tpol, k, st_data->a);
-    r1 = fmpz_sgn(t0z); // Usually (-1)^(k-1), sometimes 0
-    if (r1 != 1-2*((k-1)%2)) printf("%d %d\n", r1, k-1);
-    _fmpz_poly_evaluate_fmpz(t0z, tpol, k, st_data->b);
-    r2 = fmpz_sgn(t0z); // Usually +1, sometimes 0
-    */
-
     _fmpz_poly_evaluate_fmpz(t0z, tpol, k+1, st_data->a);    
-    fmpq_mul_fmpz(t1q, t3q, t0z);
-    if (k%2==1) change_upper(t1q);
-    else change_lower(t1q);
-    /*
-    if (r1 >= 0) change_upper(t1q);
-    if (r1 <= 0) change_lower(t1q);
-    */
+    fmpz_mul(t1z, t3z, t0z);
+    if (k%2==1) change_upper(t1z, f);
+    else change_lower(t1z, f);
     
     _fmpz_poly_evaluate_fmpz(t0z, tpol, k+1, st_data->b);
-    fmpq_mul_fmpz(t1q, t3q, t0z);
-    /*
-    if (r2 >= 0) change_lower(t1q);
-    if (r2 <= 0) change_upper(t1q);
-    */
-    change_lower(t1q);
+    fmpz_mul(t1z, t3z, t0z);
+    change_lower(t1z, f);
   } else {
     for (i=0; 2*i <= k; i++)
       fmpz_set(tpol2+i, tpol+2*i);
@@ -606,106 +1725,390 @@ int set_range_from_power_sums(ps_static_data_t *st_data,
     _fmpz_poly_evaluate_fmpz(t0z, tpol2, (k+2) / 2, t2z);
     _fmpz_poly_evaluate_fmpz(t1z, tpol3, (k+1) / 2, t2z);
     fmpz_mul_si(t1z, t1z, 2);
-    fmpq_mul_fmpz(t1q, t3q, t0z);
-    fmpq_mul_fmpz(t2q, t3q, t1z);
+    fmpz_mul(t0z, t0z, t3z);
+    fmpz_mul(t1z, t1z, t3z);
 
-    change_lower_quad(t1q, t2q);
+    change_lower_quad(t0z, t1z);
 
-    fmpq_neg(t2q, t2q);
-    if (k%2==1) change_upper_quad(t1q, t2q);
-    else change_lower_quad(t1q, t2q);
+    fmpz_neg(t1z, t1z);
+    if (k%2==1) change_upper_quad(t0z, t1z);
+    else change_lower_quad(t0z, t1z);
   }
 
-  /* If q=1, compute additional bounds using power sums. */
-  if (q==1 && (fmpz_cmp(lower, upper) <= 0) && k >= 2) {
-    /* The k=2 case requires separate attention; this corrects a bug
+  /* Compute additional bounds using power sums. */
+  if ((fmpz_cmp(lower, upper) <= 0) && k >= 2) {
+    /* Rows 1 and 2 give the sum of (x^2-2q) (2 sqrt(q))^(k-2) *
+       T_{k-2}(x/(2 sqrt(q))), each term of which is in [-4 q^(k/2), 4 q^(k/2)].
+       The k=2 case requires separate attention; this corrects a bug
        in the 2008 implementation.
     */
-    fmpq_add(t1q, fmpq_mat_entry(dy_data->sum_prod, 1, 0),
-	     fmpq_mat_entry(dy_data->sum_prod, 2, 0));
-    fmpq_set_si(t2q, 4*d, 1);
-    fmpq_sub(t0q, t1q, t2q);
-    // fmpq_sub_si(t3q, t1q, 4*d);
-    if (k==2) fmpq_div_fmpz(t0q, t0q, st_data->b); // b=2
-    change_lower(t0q);
-    fmpq_add(t0q, t1q, t2q);
-    // fmpq_add_si(t3q, t1q, 4*d);
-    if (k==2) fmpq_div_fmpz(t0q, t0q, st_data->b); // b=2
-    change_upper(t0q);
-    
-    /* t1q, t2q, t3q are no longer needed, so can be reassigned. */
-    t1q = fmpq_mat_entry(dy_data->sum_prod, 3, 0);
-    t2q = fmpq_mat_entry(dy_data->sum_prod, 4, 0);
-    t3q = fmpq_mat_entry(dy_data->sum_prod, 5, 0);
-    if (fmpq_sgn(t3q) > 0) { // t0q <- t1q - t2q^2/t3q
-      fmpq_mul(t0q, t2q, t2q);
-      fmpq_div(t0q, t0q, t3q);
-      fmpq_sub(t0q, t1q, t0q);
-      change_upper(t0q);
-    }
-    fmpq_set_si(t3q, -4, 1);
-    fmpq_mul(t0q, t3q, t2q);
-    // fmpq_mul_si(t0q, t2q, -4);
-    fmpq_add(t0q, t0q, t1q);
-    change_lower(t0q);
-    
-    t1q = fmpq_mat_entry(dy_data->sum_prod, 6, 0);
-    t2q = fmpq_mat_entry(dy_data->sum_prod, 7, 0);
-    t3q = fmpq_mat_entry(dy_data->sum_prod, 8, 0);
-    if ((k%2 == 0) && (fmpq_sgn(t3q) > 0)) {
-      fmpq_mul(t0q, t2q, t2q);
-      fmpq_div(t0q, t0q, t3q);
-      fmpq_sub(t0q, t1q, t0q);
-      change_upper(t0q);
-    } else if ((k%2 == 1) && (fmpq_sgn(t3q) < 0)) {
-      fmpq_mul(t0q, t2q, t2q);
-      fmpq_div(t0q, t0q, t3q);
-      fmpq_sub(t0q, t1q, t0q);
-      change_lower(t0q);
-    }
-    fmpq_set_si(t0q, 4, 1);
-    fmpq_mul(t0q, t0q, t2q);
-    // fmpq_mul_si(t0q, t2q, 4);
-    fmpq_add(t0q, t0q, t1q);
-    if (k%2 == 0) change_lower(t0q);
-    else change_upper(t0q);
-    
+    fmpz_add(t1z, sum_prod+1, sum_prod+2);
+    fmpz_set_si(t2z, q);
+    fmpz_pow_ui(t2z, t2z, k/2);
+    fmpz_mul_si(t2z, t2z, 4*d);
+    fmpz_mul(t2z, t2z, lead_pow+k);
     if (k%2 == 0) {
-	fmpq_set_si(t0q, -4, 1);
-	fmpq_mul(t0q, t0q, fmpq_mat_entry(dy_data->sum_col, k-2, 0));
-      // fmpq_mul_si(t0q, fmpq_mat_entry(dy_data->sum_col, k-2, 0), -4);
-	fmpq_add(t0q, t0q, fmpq_mat_entry(dy_data->sum_col, k, 0));
-	change_lower(t0q);	
+      if (k==2) fmpz_mul_2exp(t3z, f, 1);
+      else fmpz_set(t3z, f);
+      fmpz_sub(t0z, t1z, t2z);
+      change_lower(t0z, t3z);
+      fmpz_add(t0z, t1z, t2z);
+      change_upper(t0z, t3z);
+    } else {
+      change_upper_quad(t1z, t2z);
+      fmpz_neg(t2z, t2z);
+      change_lower_quad(t1z, t2z);
+    }
+
+    if (q == 1) {
+      /* Bounds of the form t1 - t2^2/t3 are cleared of denominators. */
+      t1z = sum_prod+3;
+      t2z = sum_prod+4;
+      t3z = sum_prod+5;
+      if (fmpz_sgn(t3z) > 0) { // t0 <- t1 - t2^2/t3
+        fmpz_mul(t0z, t1z, t3z);
+        fmpz_submul(t0z, t2z, t2z);
+        fmpz_mul(t4z, t3z, f);
+        change_upper(t0z, t4z);
+      }
+      fmpz_mul_si(t0z, t2z, -4);
+      fmpz_add(t0z, t0z, t1z);
+      change_lower(t0z, f);
+    
+      t1z = sum_prod+6;
+      t2z = sum_prod+7;
+      t3z = sum_prod+8;
+      if ((k%2 == 0) && (fmpz_sgn(t3z) > 0)) {
+        fmpz_mul(t0z, t1z, t3z);
+        fmpz_submul(t0z, t2z, t2z);
+        fmpz_mul(t4z, t3z, f);
+        change_upper(t0z, t4z);
+      } else if ((k%2 == 1) && (fmpz_sgn(t3z) < 0)) {
+        fmpz_mul(t0z, t2z, t2z);
+        fmpz_submul(t0z, t1z, t3z);
+        fmpz_mul(t4z, t3z, f);
+        fmpz_neg(t4z, t4z);
+        change_lower(t0z, t4z);
+      }
+      fmpz_mul_si(t0z, t2z, 4);
+      fmpz_add(t0z, t0z, t1z);
+      if (k%2 == 0) change_lower(t0z, f);
+      else change_upper(t0z, f);
+    } else {
+      /* The sums of (x + 2 sqrt(q))^j for j = k, k-1, k-2 are
+	 e_i + o_i sqrt(q) (i = 0, 1, 2), and the sums of (x - 2 sqrt(q))^j
+	 are their conjugates; we apply the same bounds as for q=1. */
+      fmpz *e0 = sum_prod+3, *e1 = sum_prod+4, *e2 = sum_prod+5;
+      fmpz *o0 = sum_prod+6, *o1 = sum_prod+7, *o2 = sum_prod+8;
+
+      /* t0 + t4 sqrt(q) = (e0 + o0 sqrt(q))(e2 + o2 sqrt(q))
+	                   - (e1 + o1 sqrt(q))^2. */
+      fmpz_mul(t2z, o0, o2);
+      fmpz_submul(t2z, o1, o1);
+      fmpz_mul_si(t2z, t2z, q);
+      fmpz_mul(t0z, e0, e2);
+      fmpz_add(t0z, t0z, t2z);
+      fmpz_submul(t0z, e1, e1);
+      fmpz_mul(t4z, e0, o2);
+      fmpz_addmul(t4z, o0, e2);
+      fmpz_mul(t2z, e1, o1);
+      fmpz_mul_2exp(t2z, t2z, 1);
+      fmpz_sub(t4z, t4z, t2z);
+
+      if (fmpz_sgn_quad(e2, o2, q, u, u+1) > 0)
+	change_upper_ratio(t0z, t4z, e2, o2);
+      fmpz_neg(t3z, o2);
+      r = fmpz_sgn_quad(e2, t3z, q, u, u+1);
+      if ((k%2 == 0) && (r > 0)) {
+	fmpz_neg(t4z, t4z);
+	change_upper_ratio(t0z, t4z, e2, t3z);
+      } else if ((k%2 == 1) && (r < 0)) {
+	fmpz_neg(t0z, t0z);
+	fmpz_neg(t3z, e2);
+	change_lower_ratio(t0z, t4z, t3z, o2);
       }
+
+      /* t0 + t1 sqrt(q) = (e0 + o0 sqrt(q)) - 4 sqrt(q) (e1 + o1 sqrt(q)). */
+      fmpz_mul_si(t0z, o1, -4*q);
+      fmpz_add(t0z, t0z, e0);
+      fmpz_mul_si(t1z, e1, -4);
+      fmpz_add(t1z, t1z, o0);
+      change_lower_quad(t0z, t1z);
+      fmpz_neg(t1z, t1z);
+      if (k%2 == 0) change_lower_quad(t0z, t1z);
+      else change_upper_quad(t0z, t1z);
+    }
+
+    if (k%2 == 0) {
+      /* -4q s_{k-2} + s_k, scaled by lead^k. */
+      fmpz_mul_si(t0z, lead_pow+2, -4*q);
+      fmpz_mul(t0z, t0z, sum_col+k-2);
+      fmpz_add(t0z, t0z, sum_col+k);
+      change_lower(t0z, f);
+    }
   }
-  if (fmpz_cmp(lower, upper) > 0) return(0);
-  /*
-  fmpz_sub(t0z, upper, lower);
-  if (fmpz_cmp_ui(t0z, 10) > 0) {
-    fmpz_print(t0z);
-    printf("\n");
+  /* Apply the Hankel positivity test. */
+  if (hk && (fmpz_cmp(lower, upper) <= 0)) {
+    fmpz_mul(t0z, hkb+1, f);
+    change_upper(hkb, t0z);
+    fmpz_mul(t0z, hkb+3, f);
+    change_lower(hkb+2, t0z);
+  }
+
+  /* Apply the point count constraint: V - count_b[k]*f*i >= 0. */
+  if (st_data->point_count != NULL && (fmpz_cmp(lower, upper) <= 0)
+      && !fmpz_is_zero(st_data->count_b+k)) {
+    point_count_value(st_data, dy_data, t0z, t4z);
+    fmpz_mul(t4z, st_data->count_b+k, f);
+    if (fmpz_sgn(t4z) > 0) change_upper(t0z, t4z);
+    else {
+      fmpz_neg(t0z, t0z);
+      fmpz_neg(t4z, t4z);
+      change_lower(t0z, t4z);
+    }
+  }
+  PS_STAT(dy_data, n, bound_cycles, PS_CYCLES() - bound_t0);
+  if (fmpz_cmp(lower, upper) > 0) {
+    PS_STAT(dy_data, n, empty, 1);
+    return(0);
+  }
+
+  /* Find the values of pol[n-1] passing the Sturm test of the children. */
+  dy_data->sturm_ok[n-1] = 0;
+  if (st_data->sturm_bisect) {
+    r = sturm_bisect(st_data, dy_data, lower, upper);
+    if (r<=0) {
+      PS_STAT(dy_data, n, sturm_fail, 1);
+      return(r);
+    }
+    dy_data->sturm_ok[n-1] = (r == 1);
   }
-  */
+#ifdef PS_STATS
+  fmpz_sub(t0z, upper, lower);
+  PS_STAT(dy_data, n, width, fmpz_get_si(t0z) + 1);
+#endif
     
   /* Set the new upper bound. */
   fmpz_mul(upper, upper, modulus);
   fmpz_add(dy_data->upper+n-1, pol+n-1, upper);
   /* Correct the k-th power sum. */
-  t1q = fmpq_mat_entry(dy_data->sum_col, k, 0);
-  fmpq_mul_fmpz(t0q, f, lower);
-  fmpq_sub(t1q, t1q, t0q);
+  fmpz_submul(sum_col+k, f, lower);
   /* Set the new polynomial value. */
   fmpz_mul(lower, lower, modulus);
   fmpz_add(pol+n-1, pol+n-1, lower);
+  if (st_data->newton != NULL && !newton_advance(st_data, dy_data, n-1)) {
+    PS_STAT(dy_data, n, empty, 1);
+    return(0);
+  }
 
   return(1);
 
 }
 
+/* Leaf filters, ported from prescribed_roots.sage. */
+
+/* Set pol2 to pol1(-x). */
+void fmpz_poly_neg_var(fmpz_poly_t pol2, const fmpz_poly_t pol1) {
+  slong i;
+  fmpz_poly_set(pol2, pol1);
+  for (i=1; i<fmpz_poly_length(pol2); i+=2)
+    fmpz_neg(pol2->coeffs+i, pol2->coeffs+i);
+}
+
+/* Set pol2 to the polynomial whose i-th coefficient is the 2i-th 
+   coefficient of pol1. */
+void fmpz_poly_even_part(fmpz_poly_t pol2, const fmpz_poly_t pol1) {
+  slong i, len = (fmpz_poly_length(pol1)+1)/2;
+  fmpz_poly_t temp;
+  fmpz_poly_init2(temp, len);
+  for (i=0; i<len; i++)
+    fmpz_poly_set_coeff_fmpz(temp, i, pol1->coeffs+2*i);
+  fmpz_poly_swap(pol2, temp);
+  fmpz_poly_clear(temp);
+}
+
+/* Return 1 if pol is irreducible (or a power of an irreducible) and not
+   cyclotomic, and 0 if it is divisible by a cyclotomic polynomial; see
+   no_roots_of_unity in prescribed_roots.sage. */
+int ps_no_roots_of_unity(const fmpz_poly_t pol) {
+  fmpz_poly_t pol1, pol2, pol3;
+  int r = 1;
+
+  fmpz_poly_init(pol1);
+  fmpz_poly_init(pol2);
+  fmpz_poly_init(pol3);
+  fmpz_poly_set(pol1, pol);
+  fmpz_poly_neg_var(pol2, pol1);
+  /* Force pol1 not to be even. */
+  while (fmpz_poly_degree(pol1) > 0 && fmpz_poly_equal(pol1, pol2)) {
+    fmpz_poly_even_part(pol1, pol1);
+    fmpz_poly_neg_var(pol2, pol1);
+  }
+  fmpz_poly_gcd(pol3, pol1, pol2);
+  if (fmpz_poly_degree(pol3) > 0) r = 0; /* zeta_{*}, v_2(*) >= 2 */
+  if (r) {
+    fmpz_poly_mul(pol3, pol1, pol2);
+    fmpz_poly_even_part(pol3, pol3);
+    fmpz_poly_gcd(pol2, pol1, pol3);
+    if (fmpz_poly_degree(pol2) > 0) r = 0; /* zeta_{*}, v_2(*) = 0 */
+  }
+  if (r) {
+    fmpz_poly_neg_var(pol3, pol3);
+    fmpz_poly_gcd(pol2, pol1, pol3);
+    if (fmpz_poly_degree(pol2) > 0) r = 0; /* zeta_{*}, v_2(*) = 1 */
+  }
+  fmpz_poly_clear(pol1);
+  fmpz_poly_clear(pol2);
+  fmpz_poly_clear(pol3);
+  return(r);
+}
+
+/* Elsenhans-Jahnel condition based on the Artin-Tate formula: with
+   pol = (1-x)^m pol1 and pol1(1) != 0, sign(pol(0)) pol1(-1) must be a
+   square; see ej_test in prescribed_roots.sage. */
+int ps_ej_test(const fmpz_poly_t pol) {
+  fmpz_poly_t pol1, rem, lin;
+  fmpz_t t;
+  int r, m = 0;
+
+  if (fmpz_poly_is_zero(pol) || fmpz_is_zero(pol->coeffs)) return(1);
+  fmpz_poly_init(pol1);
+  fmpz_poly_init(rem);
+  fmpz_poly_init(lin);
+  fmpz_init(t);
+  fmpz_poly_set_coeff_si(lin, 0, -1);
+  fmpz_poly_set_coeff_si(lin, 1, 1);
+  fmpz_poly_set(pol1, pol);
+  while (1) {
+    fmpz_one(t);
+    fmpz_poly_evaluate_fmpz(t, pol1, t);
+    if (!fmpz_is_zero(t)) break;
+    fmpz_poly_divrem(pol1, rem, pol1, lin);
+    m++;
+  }
+  fmpz_set_si(t, -1);
+  fmpz_poly_evaluate_fmpz(t, pol1, t);
+  if (m%2) fmpz_neg(t, t);
+  if (fmpz_sgn(pol->coeffs) < 0) fmpz_neg(t, t);
+  r = (fmpz_sgn(t) >= 0 && fmpz_is_square(t));
+  fmpz_poly_clear(pol1);
+  fmpz_poly_clear(rem);
+  fmpz_poly_clear(lin);
+  fmpz_clear(t);
+  return(r);
+}
+
+/* Return 1 if sympol passes the filters selected in st_data->filter
+   (a combination of PS_FILTER_NO_ROOTS_OF_UNITY and PS_FILTER_EJ). */
+int ps_filter(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data) {
+  fmpz_poly_t pol;
+  slong i, len = 2*st_data->d+3;
+  int r = 1;
+
+  fmpz_poly_init2(pol, len);
+  for (i=0; i<len; i++)
+    fmpz_poly_set_coeff_fmpz(pol, i, dy_data->sympol+i);
+  if ((st_data->filter & PS_FILTER_NO_ROOTS_OF_UNITY) &&
+      !ps_no_roots_of_unity(pol))
+    r = 0;
+  if (r && (st_data->filter & PS_FILTER_EJ) && !ps_ej_test(pol))
+    r = 0;
+  fmpz_poly_clear(pol);
+  return(r);
+}
+
+/* Count the leaves below a node at level 1 in count-only mode, once
+   set_range_from_power_sums has set the range of pol[0]. The values of
+   pol[0] passing the leaf test form an interval (see next_pol), so once
+   one passes, the end of the interval is found by galloping and
+   bisection instead of testing every value. The state, *count and
+   dy_data->solutions are left as next_pol would leave them after running
+   through these leaves one at a time; return the resulting value of
+   ascend, or 0 if the range of pol[0] is too large to handle here. */
+static int count_leaves(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+			long *count) {
+  int d = st_data->d;
+  fmpz *modulus = st_data->modlist;
+  fmpz *pol = dy_data->pol;
+  fmpz *G = dy_data->w;
+  fmpz *w = dy_data->w + d+1;
+  fmpz *t0z = dy_data->w + 3*d+3;
+  slong m, s, j, lo, hi, step;
+  long fails = 0;
+  int r, ascend;
+
+  /* The leaf test of set_range_from_power_sums at pol[0] + j*modulus. */
+  int leaf_test(slong j) {
+    int k;
+    if (dy_data->sturm_ok[0]) return(1);
+    _fmpz_vec_set(G+1, pol+1, d);
+    fmpz_set_si(G, j);
+    fmpz_mul(G, G, modulus);
+    fmpz_add(G, G, pol);
+    PS_TIMED(dy_data, 0, real_cycles,
+	     k = all_roots_real(G, d+1, w, dy_data->ws));
+    return(k);
+  }
+
+  fmpz_sub(t0z, dy_data->upper, pol);
+  fmpz_fdiv_q(t0z, t0z, modulus);
+  if (!fmpz_fits_si(t0z) || fmpz_cmp_si(t0z, WORD_MAX/2) >= 0) return(0);
+  m = fmpz_get_si(t0z);
+
+  /* Test the values in turn up to the first solution, as next_pol would. */
+  for (s=0; s<=m; s++) {
+    r = leaf_test(s);
+    if (r > 0) break;
+    fails += 1;
+    if (r < 0) break;
+  }
+  if (s > m) {
+    j = m+1;
+    ascend = 1;
+  } else if (r < 0) {
+    PS_STAT_ABORT(dy_data, 0, -r-1);
+    j = s;
+    ascend = -r;
+  } else {
+    lo = s;
+    for (step=1; lo+step <= m && leaf_test(lo+step) > 0; step *= 2)
+      lo += step;
+    hi = (lo+step <= m) ? lo+step : m+1;
+    while (hi-lo > 1) {
+      j = lo + (hi-lo)/2;
+      if (leaf_test(j) > 0) lo = j;
+      else hi = j;
+    }
+    dy_data->solutions += lo-s+1;
+    j = lo+1;
+    ascend = 1;
+    /* The first failure after a solution aborts the remaining leaves. */
+    if (j <= m) {
+      r = leaf_test(j);
+      fails += 1;
+      PS_STAT_ABORT(dy_data, 0, r < 0 ? -r-1 : 0);
+      if (r < 0) ascend = -r;
+    }
+  }
+  PS_STAT(dy_data, 0, nodes, (j <= m) ? j+1 : m+1);
+  PS_STAT(dy_data, 0, sturm_fail, fails);
+  *count += fails;
+
+  /* Step pol[0] and the d-th power sum as next_pol would have. */
+  fmpz_set_si(t0z, j);
+  fmpz_addmul(pol, t0z, modulus);
+  fmpz_set_si(t0z, (j <= m) ? j : m);
+  fmpz_submul(dy_data->sum_col+d, t0z, st_data->f);
+  dy_data->n = 0;
+  return(ascend);
+}
+
 /* Return values:
     1: if a solution has been found
     0: if the tree has been exhausted
    -1: if the maximum number of nodes has been reached
+   -2: if *dy_data->interrupt was set; the state may then be split
+       with ps_dynamic_split, and calling next_pol again resumes the search
 */
 
 int next_pol(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data) {
@@ -713,22 +2116,38 @@ int next_pol(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data) {
 
   int d = st_data->d;
   int verbosity = st_data->verbosity;
-  int node_count = st_data->node_count;
+  long node_count = st_data->node_count;
   fmpz *modlist = st_data->modlist;
 
   int ascend = dy_data->ascend;
   int n = dy_data->n;
-  int count = dy_data->count;
+  long count = dy_data->count;
   fmpz *upper = dy_data->upper;
   fmpz *pol = dy_data->pol;
   fmpz *sympol = dy_data->sympol;
 
-  int i, j, t, r;
-  fmpq *tq;
+  int i, t, r;
+  /* Whether count_leaves can stand in for the leaves: it does not
+     apply the leaf filters or newton_advance, nor print or stop
+     partway through. */
+  int batch = st_data->count_only && !st_data->filter &&
+    st_data->newton == NULL && node_count == -1 && verbosity < d &&
+    !fmpz_is_zero(modlist);
+  int center = st_data->order == PS_ORDER_CENTER && !st_data->count_only &&
+    st_data->newton == NULL;
 
   if (n>d) return(0);
   while (1) {
     if (ascend > 0) {
+      /* Only stop while ascending by a single level: at this point the
+	 state can be split or resumed without changing the traversal. */
+      if (ascend == 1 &&
+	  ((dy_data->interrupt != NULL &&
+	    __atomic_load_n(dy_data->interrupt, __ATOMIC_RELAXED)) ||
+	   (dy_data->count_limit != -1 && count >= dy_data->count_limit))) {
+	t = -2;
+	break;
+      }
       n += 1;
       if (n>d) { t=0; break; }
     } else {
@@ -744,23 +2163,27 @@ int next_pol(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data) {
 	if (n<0) { 
 	  t=1; 
 	  /* Convert back into symmetric form. */
-	  _fmpz_vec_zero(sympol, 2*d+3);
-	  fmpz *temp = dy_data->w;
-	  for (i=0; i<=d; i++) {
-	    fmpz_one(temp);
-	    for (j=0; j<=i; j++) {
-	      fmpz_addmul(sympol+d-i+2*j, pol+i, temp);
-	      if (j<i) {
-		fmpz_mul_si(temp, temp, st_data->q);
-		fmpz_mul_si(temp, temp, i-j);
-		fmpz_divexact_si(temp, temp, j+1);
-	      }
-	    }
+	  if (!st_data->count_only || st_data->filter)
+	    ps_symmetrize(sympol, pol, d, st_data->q, st_data->sign,
+			  st_data->cofactor, dy_data->w);
+	  /* Discard solutions rejected by the leaf filters, and carry on
+	     as if next_pol had returned and been called again; likewise
+	     for solutions in count-only mode, once counted. */
+	  if (st_data->filter && !ps_filter(st_data, dy_data)) {
+	    dy_data->n = n;
+	    ascend = 1;
+	    continue;
+	  }
+	  if (st_data->count_only) {
+	    dy_data->solutions += 1;
+	    dy_data->n = n;
+	    ascend = 1;
+	    continue;
 	  }
-	  _fmpz_vec_scalar_mul_si(sympol, sympol, 2*d+1, st_data->sign);
-	  _fmpz_poly_mul_KS(sympol,sympol, 2*d+1, st_data->cofactor, 3);
 	  break; 
 	}
+	if (center) ps_wrap_center(st_data, dy_data, n);
+	if (n==0 && batch) ascend = count_leaves(st_data, dy_data, &count);
 	continue;
       } else {
 	count += 1;
@@ -768,32 +2191,543 @@ int next_pol(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data) {
 	if (r<-1) {
 	  /* Early abort: Sturm test failed on a coefficient determined at 
 	     a previous level. */
-	  ascend = -r-1;
+	  PS_STAT_ABORT(dy_data, n, -r-1);
+	  ascend = ps_wrap_skip(st_data, dy_data, n, -r-1);
 	  continue;
 	} else if (r==-1 && i<n) { 
 	/* Early abort: given the previous coefficient, the set of values for
 	   a given coefficient giving the right position of real roots for
 	   the corresponding derivative is always an interval. */
-	ascend = 1;
+	PS_STAT_ABORT(dy_data, n, 0);
+	ascend = ps_wrap_skip(st_data, dy_data, n, 1);
 	continue;
 	}
       }
     }
-    if (ascend>1) ascend -= 1;
-    else if (fmpq_is_zero(modlist+n)) ascend = 1;
+    if (ascend>1) ascend = ps_wrap_skip(st_data, dy_data, n, ascend-1);
+    else if (fmpz_is_zero(modlist+n)) ascend = 1;
     else {
       fmpz_add(pol+n, pol+n, modlist+n);
-      if (fmpz_cmp(pol+n, upper+n) > 0) ascend = 1;
-      else {
+      if (fmpz_cmp(pol+n, upper+n) > 0) {
+	ascend = 1;
+	if (ps_wrap_pending(dy_data, n)) {
+	  fmpz_sub(pol+n, pol+n, modlist+n);
+	  ps_wrap_next(st_data, dy_data, n);
+	  ascend = 0;
+	}
+      } else {
 	ascend = 0;
 	/* Update the (d-n)-th power sum. */
-	tq = fmpq_mat_entry(dy_data->sum_col, d-n, 0);
-	fmpq_sub(tq, tq, st_data->f+n);
+	fmpz_sub(dy_data->sum_col+d-n, dy_data->sum_col+d-n, st_data->f+n);
+	if (st_data->newton != NULL && !newton_advance(st_data, dy_data, n))
+	  ascend = 1;
       }
     }
   }
-  dy_data->ascend = (n<0);
+  dy_data->ascend = (n<0 || t==-2);
   dy_data->n = n;
   dy_data->count = count;
   return(t);
 }
+
+/* Find up to max further solutions, storing their symmetrized forms 
+   (2*d+3 coefficients each, as in extract_symmetrized_pol) one after 
+   another in Q, and set *num to the number found. Return 1 if max 
+   solutions were found, and otherwise the last return value of next_pol.
+*/
+int next_pols(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+	      int *Q, int max, int *num) {
+  int t = 1;
+
+  *num = 0;
+  while (*num < max && (t = next_pol(st_data, dy_data)) > 0) {
+    extract_symmetrized_pol(Q + (*num)*(2*st_data->d+3), dy_data);
+    *num += 1;
+  }
+  return(t);
+}
+
+/* Return a new state covering the children of the node of dy_data at
+   level level+1 (the values of pol[level]), once set_range_from_power_sums
+   has succeeded there: searching it with next_pol stops once they are
+   done. */
+ps_dynamic_data_t *ps_dynamic_shard(ps_dynamic_data_t *dy_data, int level) {
+  ps_dynamic_data_t *shard;
+  int m;
+
+  shard = ps_dynamic_clone(dy_data);
+  shard->n = level;
+  shard->ascend = 0;
+  shard->count = 0;
+  shard->solutions = 0;
+  for (m=level+1; m<=dy_data->d; m++)
+    fmpz_set(shard->upper+m, shard->pol+m);
+  return(shard);
+}
+
+/* Once set_range_from_power_sums has succeeded at level n, move pol[n-1]
+   up to c, updating the (d-n+1)-th power sum, and return 1 if c is one
+   of the values allowed there from pol[n-1] on. Otherwise, return 0 and
+   leave dy_data alone. This lets a caller follow given paths down the
+   tree (see session.c); newton_advance is not applied. */
+int ps_dynamic_select(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		      int n, slong c) {
+  int d = st_data->d;
+  fmpz *modulus = st_data->modlist + n-1;
+  fmpz *pol = dy_data->pol + n-1;
+  fmpz *t = dy_data->w;
+
+  fmpz_set_si(t, c);
+  fmpz_sub(t, t, pol);
+  if (fmpz_is_zero(t)) return(1);
+  /* If modulus==0, pol[n-1] is fixed and upper[n-1] is not set. */
+  if (fmpz_is_zero(modulus) || fmpz_sgn(t) < 0 ||
+      !fmpz_divisible(t, modulus) ||
+      fmpz_cmp_si(dy_data->upper+n-1, c) < 0)
+    return(0);
+  fmpz_divexact(t, t, modulus);
+  fmpz_submul(dy_data->sum_col+d-n+1, t, st_data->f+n-1);
+  fmpz_set_si(pol, c);
+  return(1);
+}
+
+/* Walk the tree below dy_data as next_pol would, except that the nodes
+   at level level+1 are not descended into. For each of them which
+   succeeds, emit is called with a new state covering its children (the
+   values of pol[level]), which the caller then owns; searching it with
+   next_pol does what next_pol would do from that point on, up to where
+   it leaves the subtree. For each failed node, emit is called with
+   shard NULL, dy_data->n and pol describing the node.
+
+   The only interaction between the subtrees is through aborts skipping
+   more than the siblings of a node (r < -2 in next_pol). These are not
+   followed here: the walk carries on with the parent's next sibling, and
+   escape is set to the level at which next_pol would carry on instead
+   (d+1 if it would stop), so that the caller can skip what lies between
+   (see shard.c). Otherwise, escape is -1.
+*/
+void ps_frontier(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		 int level,
+		 void (*emit)(void *arg, ps_dynamic_data_t *dy_data,
+			      ps_dynamic_data_t *shard, int escape),
+		 void *arg) {
+  int d = st_data->d;
+  fmpz *modlist = st_data->modlist;
+  fmpz *pol = dy_data->pol;
+  fmpz *upper = dy_data->upper;
+  int ascend = dy_data->ascend;
+  int n = dy_data->n;
+  int i, r, escape;
+  ps_dynamic_data_t *shard;
+
+  if (n>d) return;
+  while (1) {
+    if (ascend > 0) {
+      n += 1;
+      if (n>d) break;
+    } else {
+      i = dy_data->n;
+      dy_data->n = n;
+      r = set_range_from_power_sums(st_data, dy_data);
+      if (r > 0) {
+	if (n > level+1) {
+	  n -= 1;
+	  continue;
+	}
+	shard = ps_dynamic_shard(dy_data, level);
+	emit(arg, dy_data, shard, -1);
+	/* Carry on as next_pol does once the children are done. */
+	dy_data->n = level;
+	n = level;
+	ascend = 1;
+	continue;
+      }
+      escape = -1;
+      if (r < -2) {
+	/* Where next_pol would step to the next sibling. */
+	for (escape = n-r-1; escape <= d; escape++)
+	  if (!fmpz_is_zero(modlist+escape)) break;
+      }
+      emit(arg, dy_data, NULL, escape);
+      if (r < -1 || (r == -1 && i < n)) {
+	ascend = 1;
+	continue;
+      }
+    }
+    if (fmpz_is_zero(modlist+n)) ascend = 1;
+    else {
+      fmpz_add(pol+n, pol+n, modlist+n);
+      if (fmpz_cmp(pol+n, upper+n) > 0) ascend = 1;
+      else {
+	ascend = 0;
+	fmpz_sub(dy_data->sum_col+d-n, dy_data->sum_col+d-n, st_data->f+n);
+	if (st_data->newton != NULL && !newton_advance(st_data, dy_data, n))
+	  ascend = 1;
+      }
+    }
+  }
+  dy_data->n = n;
+  dy_data->ascend = 1;
+}
+
+/* Tree size estimation (Knuth's estimator).
+
+   A probe walks from the node of dy_data down to a leaf. At each node on
+   the way, it evaluates the children one after another as next_pol
+   would, with the same early aborts, and picks one of those with
+   children of their own at random to continue from. Weighting each node
+   by the inverse of the probability of reaching it gives an unbiased
+   estimate of the number of failed children (as counted by next_pol),
+   of solutions and of all nodes in the tree. Since the children are all
+   evaluated, the failed ones and the solutions are counted exactly; only
+   the choice of the path is random.
+
+   With PS_ESTIMATE_WEIGHTED, the child is chosen with probability
+   proportional to the number of values allowed for its next coefficient,
+   rather than uniformly; this usually reduces the variance.
+
+   Aborts skipping the remaining siblings of a parent (r < -2 in next_pol)
+   are not seen by a probe, which visits a single child; the estimates
+   can therefore be somewhat high.
+*/
+
+/* splitmix64, so that the probes only depend on the seed. */
+static ulong ps_random(ulong *s) {
+  ulong z = (*s += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return(z ^ (z >> 31));
+}
+
+/* Uniform in [0, 1). */
+static double ps_random_unit(ulong *s) {
+  return((ps_random(s) >> 11) * (1.0/9007199254740992.0));
+}
+
+/* The number of values of pol[m-1], after set_range_from_power_sums has
+   succeeded at level m. */
+static double ps_estimate_width(ps_static_data_t *st_data,
+				ps_dynamic_data_t *dy_data, int m) {
+  fmpz *modulus = st_data->modlist + m-1;
+  double r;
+  fmpz_t t;
+
+  if (fmpz_is_zero(modulus)) return(1.0);
+  fmpz_init(t);
+  fmpz_sub(t, dy_data->upper+m-1, dy_data->pol+m-1);
+  fmpz_fdiv_q(t, t, modulus);
+  r = fmpz_get_d(t) + 1.0;
+  fmpz_clear(t);
+  return(r);
+}
+
+/* Run one probe, setting est to its estimates of the count, the number
+   of solutions and the number of nodes. The probe starts with the values
+   of pol[n] from the current one up to upper[n], as next_pol would (for
+   a state from ps_dynamic_init, this is just the root). If Q is not NULL
+   and the probe reaches solutions, one of these, chosen uniformly, is
+   stored there (see ps_sample). */
+static void ps_probe(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		     ulong *seed, int flags, double *est, long *cost, int *Q) {
+  int d = st_data->d;
+  int m, i, r;
+  long fail, succ, found = 0;
+  double W = 1.0, w, pick_w, total;
+  ps_dynamic_data_t *cur, *pick;
+
+  est[0] = est[1] = est[2] = 0.0;
+  cur = ps_dynamic_clone(dy_data);
+  m = cur->n;
+  while (1) {
+    /* Visit the children at level m of the node chosen last. */
+    fail = succ = 0;
+    total = pick_w = 0.0;
+    pick = NULL;
+    i = m+1; /* as in next_pol, the level visited last */
+    while (1) {
+      cur->n = m;
+      *cost += 1;
+      r = set_range_from_power_sums(st_data, cur);
+      if (r > 0) {
+	succ += 1;
+	if (m == 0) {
+	  ps_symmetrize(cur->sympol, cur->pol, d, st_data->q, st_data->sign,
+			st_data->cofactor, cur->w);
+	  if (!st_data->filter || ps_filter(st_data, cur)) {
+	    est[1] += W;
+	    found += 1;
+	    if (Q != NULL && ps_random_unit(seed) * found < 1.0)
+	      extract_symmetrized_pol(Q, cur);
+	  }
+	} else {
+	  /* Reservoir sampling of the child to continue from. */
+	  w = (flags & PS_ESTIMATE_WEIGHTED) ?
+	    ps_estimate_width(st_data, cur, m) : 1.0;
+	  total += w;
+	  if (ps_random_unit(seed) * total < w) {
+	    if (pick != NULL) ps_dynamic_clear(pick);
+	    pick = ps_dynamic_clone(cur);
+	    pick_w = w;
+	  }
+	}
+	i = m-1;
+      } else {
+	fail += 1;
+	if (r < -1 || (r == -1 && i < m)) break;
+	i = m;
+      }
+      /* Move on to the next sibling, as in next_pol. */
+      if (fmpz_is_zero(st_data->modlist+m)) break;
+      fmpz_add(cur->pol+m, cur->pol+m, st_data->modlist+m);
+      if (fmpz_cmp(cur->pol+m, cur->upper+m) > 0) break;
+      fmpz_sub(cur->sum_col+d-m, cur->sum_col+d-m, st_data->f+m);
+      if (st_data->newton != NULL && !newton_advance(st_data, cur, m))
+	break;
+    }
+    est[0] += W*fail;
+    est[2] += W*(fail+succ);
+    ps_dynamic_clear(cur);
+    if (pick == NULL) return;
+    W *= total/pick_w;
+    cur = pick;
+    m -= 1;
+  }
+}
+
+/* Estimate the size of the tree below dy_data, which must not have been
+   started (as returned by ps_dynamic_init, or a shard in a manifest),
+   from the given number of probes; the probes only depend on the seed.
+   dy_data is left alone.
+   Return 1 on success, 0 if dy_data cannot be used. */
+int ps_estimate(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		long probes, ulong seed, int flags, ps_estimate_t *res) {
+  double est[3], mean[3], m2[3], delta;
+  long i, j;
+
+  memset(res, 0, sizeof(ps_estimate_t));
+  if (dy_data == NULL || dy_data->ascend != 0 || dy_data->n > st_data->d ||
+      probes <= 0)
+    return(0);
+  for (j=0; j<3; j++) mean[j] = m2[j] = 0.0;
+  /* Welford's method for the mean and variance of the estimates. */
+  for (i=1; i<=probes; i++) {
+    ps_probe(st_data, dy_data, &seed, flags, est, &res->cost, NULL);
+    for (j=0; j<3; j++) {
+      delta = est[j] - mean[j];
+      mean[j] += delta/i;
+      m2[j] += delta*(est[j] - mean[j]);
+    }
+  }
+  res->probes = probes;
+  res->count = mean[0];
+  res->solutions = mean[1];
+  res->nodes = mean[2];
+  if (probes > 1) {
+    res->count_err = sqrt(m2[0]/(probes-1)/probes);
+    res->solutions_err = sqrt(m2[1]/(probes-1)/probes);
+    res->nodes_err = sqrt(m2[2]/(probes-1)/probes);
+  }
+  return(1);
+}
+
+/* Random sampling of the solutions.
+
+   A sample is drawn by a probe as in ps_estimate, which also picks one of
+   the solutions at the leaves it reaches, uniformly; its weight, the
+   inverse of the probability of drawing it, is then the probe's estimate
+   of the number of solutions. Probes reaching no solution are repeated.
+   The weights allow exact reweighting: the mean of a function over all
+   solutions is estimated by its mean over the samples, weighted by these,
+   and the number of solutions by the sum of the weights of all probes
+   divided by their number.
+
+   With PS_SAMPLE_DIRECT, a probe instead draws the value of each
+   coefficient uniformly from the range set by its parent, and only tests
+   that one, dying out as soon as a test fails (see ps_probe_direct). The
+   probes are much cheaper, as they visit at most d+1 nodes, but more of
+   them die out; this pays off when the ranges are wide.
+
+   With PS_SAMPLE_UNIFORM, a sample of weight w is only kept with
+   probability w/bound, and then gets weight 1, so that every solution is
+   drawn with the same probability, provided no weight exceeds bound;
+   those which do are kept anyway, and counted in res->excess. */
+
+/* Run one probe as described above for PS_SAMPLE_DIRECT. If it reaches a
+   solution, store it in Q and return its weight; otherwise return 0. */
+static double ps_probe_direct(ps_static_data_t *st_data,
+			      ps_dynamic_data_t *dy_data, ulong *seed,
+			      int *Q, long *cost) {
+  int d = st_data->d;
+  fmpz *modlist = st_data->modlist;
+  double W = 1.0;
+  ps_dynamic_data_t *cur;
+  fmpz *t0z, *t1z;
+  ulong j;
+  int m;
+
+  cur = ps_dynamic_clone(dy_data);
+  t0z = cur->wp;
+  t1z = cur->wp + 1;
+  m = cur->n;
+  while (1) {
+    /* Draw pol[m] from pol[m], ..., upper[m], stepping as next_pol
+       (at the start, upper[m] may lie below pol[m]). */
+    if (!fmpz_is_zero(modlist+m)) {
+      fmpz_sub(t0z, cur->upper+m, cur->pol+m);
+      fmpz_fdiv_q(t0z, t0z, modlist+m);
+      if (fmpz_sgn(t0z) < 0) fmpz_zero(t0z);
+      if (!fmpz_fits_si(t0z)) break; /* not representable anyway */
+      j = ps_random(seed) % ((ulong)fmpz_get_si(t0z) + 1);
+      W *= fmpz_get_d(t0z) + 1.0;
+      if (j > 0) {
+	fmpz_set_ui(t0z, j);
+	fmpz_addmul(cur->pol+m, t0z, modlist+m);
+	fmpz_submul(cur->sum_col+d-m, t0z, st_data->f+m);
+	/* Only this value is a candidate: newton_advance must keep it. */
+	if (st_data->newton != NULL) {
+	  fmpz_set(t1z, cur->pol+m);
+	  if (!newton_advance(st_data, cur, m) || !fmpz_equal(t1z, cur->pol+m))
+	    break;
+	}
+      }
+    }
+    cur->n = m;
+    *cost += 1;
+    if (set_range_from_power_sums(st_data, cur) <= 0) break;
+    if (m == 0) {
+      ps_symmetrize(cur->sympol, cur->pol, d, st_data->q, st_data->sign,
+		    st_data->cofactor, cur->w);
+      if (st_data->filter && !ps_filter(st_data, cur)) break;
+      extract_symmetrized_pol(Q, cur);
+      ps_dynamic_clear(cur);
+      return(W);
+    }
+    m -= 1;
+  }
+  ps_dynamic_clear(cur);
+  return(0.0);
+}
+
+typedef struct ps_sampler {
+  ps_static_data_t *st_data;
+  ps_dynamic_data_t *dy_data;
+  long num, next;
+  ulong seed;
+  int flags;
+  double bound;
+  long max_probes;
+  int *Q;
+  double *weights;
+  pthread_mutex_t lock;
+  ps_sample_stats_t *res;
+} ps_sampler_t;
+
+/* Draw samples until there are none left to draw. Sample k only depends
+   on the seed and k, not on the thread drawing it. */
+static void *ps_sampler_run(void *arg) {
+  ps_sampler_t *sp = (ps_sampler_t *)arg;
+  int len = 2*sp->st_data->d+3;
+  ps_sample_stats_t res;
+  double est[3], w;
+  long k, probes;
+  ulong seed;
+
+  memset(&res, 0, sizeof(ps_sample_stats_t));
+  while ((k = __atomic_fetch_add(&sp->next, 1, __ATOMIC_RELAXED)) < sp->num) {
+    seed = sp->seed + (ulong)k * 0xd1b54a32d192ed03UL;
+    sp->weights[k] = 0.0;
+    for (probes=0; sp->max_probes == -1 || probes < sp->max_probes; probes++) {
+      if (sp->flags & PS_SAMPLE_DIRECT)
+	w = ps_probe_direct(sp->st_data, sp->dy_data, &seed, sp->Q + k*len,
+			    &res.cost);
+      else {
+	ps_probe(sp->st_data, sp->dy_data, &seed, sp->flags, est, &res.cost,
+		 sp->Q + k*len);
+	w = est[1];
+      }
+      res.probes += 1;
+      res.weight += w;
+      res.weight2 += w*w;
+      if (w == 0.0) continue;
+      if (w > res.max_weight) res.max_weight = w;
+      if (!(sp->flags & PS_SAMPLE_UNIFORM)) sp->weights[k] = w;
+      else if (w > sp->bound) {
+	res.excess += 1;
+	sp->weights[k] = 1.0;
+      } else if (ps_random_unit(&seed) * sp->bound < w)
+	sp->weights[k] = 1.0;
+      else continue;
+      res.samples += 1;
+      break;
+    }
+  }
+  pthread_mutex_lock(&sp->lock);
+  sp->res->samples += res.samples;
+  sp->res->probes += res.probes;
+  sp->res->excess += res.excess;
+  sp->res->cost += res.cost;
+  sp->res->weight += res.weight;
+  sp->res->weight2 += res.weight2;
+  if (res.max_weight > sp->res->max_weight)
+    sp->res->max_weight = res.max_weight;
+  pthread_mutex_unlock(&sp->lock);
+  return(NULL);
+}
+
+/* Draw num samples of the solutions below dy_data, which must not have
+   been started (as for ps_estimate), using num_threads threads. Their
+   symmetrized forms (2*d+3 coefficients each, as in
+   extract_symmetrized_pol) are stored one after another in Q, and their
+   weights in weights. A sample for which max_probes probes (unless -1)
+   reach no solution, or none kept, is given up. The flags are
+   PS_ESTIMATE_WEIGHTED, which chooses the path as for ps_estimate (unless
+   PS_SAMPLE_DIRECT is set), PS_SAMPLE_DIRECT and PS_SAMPLE_UNIFORM; the
+   samples only depend on these and on the seed.
+   Return the number of samples drawn, which come first in Q, or -1 if
+   dy_data cannot be used. */
+long ps_sample(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+	       long num, ulong seed, int flags, double bound, long max_probes,
+	       int num_threads, int *Q, double *weights,
+	       ps_sample_stats_t *res) {
+  int len = 2*st_data->d+3;
+  ps_sampler_t sp;
+  pthread_t *threads;
+  long i, j;
+  int t;
+
+  memset(res, 0, sizeof(ps_sample_stats_t));
+  if (dy_data == NULL || dy_data->ascend != 0 || dy_data->n > st_data->d ||
+      num < 0 || ((flags & PS_SAMPLE_UNIFORM) && bound <= 0.0))
+    return(-1);
+  if (num_threads < 1) num_threads = 1;
+  sp.st_data = st_data;
+  sp.dy_data = dy_data;
+  sp.num = num;
+  sp.next = 0;
+  sp.seed = seed;
+  sp.flags = flags;
+  sp.bound = bound;
+  sp.max_probes = max_probes;
+  sp.Q = Q;
+  sp.weights = weights;
+  sp.res = res;
+  pthread_mutex_init(&sp.lock, NULL);
+  threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+  for (t=0; t<num_threads; t++)
+    pthread_create(threads+t, NULL, ps_sampler_run, &sp);
+  for (t=0; t<num_threads; t++)
+    pthread_join(threads[t], NULL);
+  free(threads);
+  pthread_mutex_destroy(&sp.lock);
+
+  /* Move the samples drawn to the front. */
+  for (i=j=0; i<num; i++)
+    if (weights[i] != 0.0) {
+      if (j < i) {
+	memcpy(Q + j*len, Q + i*len, len*sizeof(int));
+	weights[j] = weights[i];
+      }
+      j++;
+    }
+  return(j);
+}
@@ -1,42 +1,202 @@
+#ifndef POWER_SUMS
+#define POWER_SUMS
+
+#include <stdio.h>
 #include <fmpz_poly.h>
-#include <fmpq.h>
-#include <fmpq_mat.h>
+#include <fmpz_mat.h>
+
+/* Primary data structures. Those fields which are described in
+   power_sums.c are marked with the function to look for there.
+ */
+
+/* The parts of the static data depending only on d, q and lead; these
+   are shared, see ps_static_table_get. */
+typedef struct ps_static_table {
+  int d, q, lead;
+  int refs;
+  fmpz *lead_pow;
+  fmpz_mat_t binom_mat;
+  fmpz_mat_t *sum_mats;
+  struct ps_static_table *next;
+} ps_static_table_t;
 
 typedef struct ps_static_data {
   int d, lead, sign, q, verbosity;
   long node_count;
+  int sturm_bisect; /* see sturm_bisect */
+  int hankel; /* see hankel_extend */
+  int filter; /* see ps_filter */
+  int count_only; /* see count_leaves */
+  int order; /* see ps_static_set_order */
   fmpz_t a, b;
-  fmpz_mat_t binom_mat;
+  ps_static_table_t *table;
+  fmpz_mat_struct *binom_mat; /* these three point into table */
+  fmpz *lead_pow;
+  fmpz_mat_t *sum_mats;
+  fmpz *cofactor; /* 3 coefficients; see ps_cofactor */
   fmpz *modlist;
-  fmpq_mat_t *sum_mats;
-  fmpq_t *f;
-  fmpz_poly_t cofactor;
+  fmpz *f;
+  int *point_count; /* see point_count_value */
+  fmpz *count_a, *count_b;
+  int *newton; /* see newton_advance */
+  fmpz *newton_lo, *newton_hi;
+  fmpz_mat_t newton_mat;
 } ps_static_data_t;
 
+/* Length of the histogram of early aborts in ps_stats_t. */
+#define PS_STATS_SKIP 32
+
+/* Counters for one level n of the tree, i.e., for the nodes at which
+   set_range_from_power_sums chooses the range of pol[n-1]. They are
+   maintained if power_sums.c is compiled with -DPS_STATS. */
+typedef struct ps_stats {
+  long nodes;          /* calls to set_range_from_power_sums */
+  long sturm_fail;     /* Sturm test failures */
+  long empty;          /* empty ranges (lower > upper) */
+  long early_abort;    /* failures also skipping the later siblings */
+  /* The early aborts by k = -r-1, for the Sturm test returning r < -1
+     (the number of levels skipped beyond the siblings), and k = 0 for
+     the others; the last entry also counts the larger values of k. */
+  long early_skip[PS_STATS_SKIP];
+  long width;          /* total of upper-lower+1 over nonempty ranges */
+  long interval_cycles; /* time in all_roots_in_interval */
+  long real_cycles;    /* time in all_roots_real */
+  long bound_cycles;   /* time spent computing lower and upper */
+} ps_stats_t;
+
+/* Each state is allocated as a single block; see ps_dynamic_alloc. */
 typedef struct ps_dynamic_data {
   int d, n, ascend;
+  int job; /* index of the static data, in a pool running a batch */
   long count;
-  fmpq_mat_t sum_col, sum_prod;
+  long solutions; /* solutions counted in count-only mode */
+  fmpz *sum_col, *sum_prod;
   fmpz *pol, *sympol, *upper;
 
+  /* With PS_ORDER_CENTER, the values of pol[i] from wrap_lo[i] to
+     wrap_hi[i] are still to be visited once pol[i] passes upper[i];
+     this range is empty if wrap_lo[i] > wrap_hi[i]. */
+  fmpz *wrap_lo, *wrap_hi;
+
+  /* sturm_ok[i] is nonzero if every value of pol[i] up to upper[i] is
+     known to pass the Sturm test in set_range_from_power_sums. */
+  int *sturm_ok;
+
+  /* Factorizations of Hankel matrices of the power sums; the first hk_n
+     rows are valid for the current node (see hankel_extend). */
+  fmpz *hk;
+  int hk_n, hklen;
+
+  /* If not NULL, next_pol returns -2 at the next point where the state
+     can be split, once this flag has been set (by another thread). */
+  int *interrupt;
+
+  /* If not -1, next_pol also returns -2 there once count reaches this;
+     the work-stealing pool uses it to share out a node budget. */
+  long count_limit;
+
   /* Scratch space */
   fmpz *w;
-  slong wlen; /* = 4*d+12 */
-  fmpq *w2;
-  slong w2len; /* = 5 */
+  int wlen; /* = 4*d+20 */
+  slong *ws;
+  int wslen; /* = 4*d+4 */
+  fmpz *wp;
+  int wplen; /* = 8*d+18 */
+
+  /* d+1 counters, indexed by n, if compiled with -DPS_STATS; else NULL.
+     A clone starts with zero counters. */
+  ps_stats_t *stats;
+
+  /* Link in the free list of released blocks. */
+  struct ps_dynamic_data *next;
 } ps_dynamic_data_t;
 
+/* Estimates of the size of a tree, with their standard errors; see
+   ps_estimate. */
+typedef struct ps_estimate {
+  long probes;
+  double count, count_err;         /* as in extract_count */
+  double solutions, solutions_err;
+  double nodes, nodes_err;         /* calls to set_range_from_power_sums */
+  long cost;                       /* the same, made by the probes */
+} ps_estimate_t;
+
+#define PS_ESTIMATE_WEIGHTED 1
+
+/* Totals over a run of ps_sample. */
+typedef struct ps_sample_stats {
+  long samples;      /* samples drawn */
+  long probes;       /* probes run, including those reaching no solution */
+  long excess;       /* uniform samples whose weight exceeded the bound */
+  long cost;         /* calls to set_range_from_power_sums */
+  double weight;     /* total weight of the probes */
+  double weight2;    /* total of the squares of these weights */
+  double max_weight; /* largest weight of a probe */
+} ps_sample_stats_t;
+
+#define PS_SAMPLE_UNIFORM 2
+#define PS_SAMPLE_DIRECT 4
+
 ps_static_data_t *ps_static_init(int d, int lead, int sign, int q,
 				 int cofactor, 
 				 int *modlist,
-				 int verbosity, long _count);
+				 int verbosity, long _count,
+				 int *point_count, int *newton);
+ps_static_table_t *ps_static_table_get(int d, int q, int lead);
+void ps_static_table_release(ps_static_table_t *table);
+void ps_static_cache_clear();
 ps_dynamic_data_t *ps_dynamic_init(int d, int *Q0);
+void ps_cofactor(fmpz *c, int cofactor, int q);
+void ps_symmetrize(fmpz *sympol, const fmpz *pol, int d, int q, int sign,
+		   const fmpz *cofactor, fmpz_t temp);
+void ps_static_set_sturm_bisect(ps_static_data_t *st_data, int flag);
+void ps_static_set_hankel(ps_static_data_t *st_data, int flag);
+
+/* Leaf filters, for ps_static_set_filter. */
+#define PS_FILTER_NO_ROOTS_OF_UNITY 1
+#define PS_FILTER_EJ 2
+void ps_static_set_filter(ps_static_data_t *st_data, int flags);
+void ps_static_set_count_only(ps_static_data_t *st_data, int flag);
+
+/* Orders of the values of each coefficient, for ps_static_set_order. */
+#define PS_ORDER_LINEAR 0
+#define PS_ORDER_CENTER 1
+void ps_static_set_order(ps_static_data_t *st_data, int order);
+int ps_no_roots_of_unity(const fmpz_poly_t pol);
+int ps_ej_test(const fmpz_poly_t pol);
 void ps_static_clear(ps_static_data_t *st_data);
 void ps_dynamic_clear(ps_dynamic_data_t *dy_data);
+void ps_dynamic_cache_clear();
 void extract_pol(int *Q, ps_dynamic_data_t *dy_data);
 void extract_symmetrized_pol(int *Q, ps_dynamic_data_t *dy_data);
 long extract_count(ps_dynamic_data_t *dy_data);
+long extract_solutions(ps_dynamic_data_t *dy_data);
+int ps_stats_enabled();
+void ps_stats_add(ps_stats_t *res, const ps_stats_t *stats, int d);
 ps_dynamic_data_t *ps_dynamic_clone(ps_dynamic_data_t *dy_data);
 ps_dynamic_data_t *ps_dynamic_split(ps_dynamic_data_t *dy_data);
+int set_range_from_power_sums(ps_static_data_t *st_data,
+			      ps_dynamic_data_t *dy_data);
+ps_dynamic_data_t *ps_dynamic_shard(ps_dynamic_data_t *dy_data, int level);
+int ps_dynamic_select(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		      int n, slong c);
 int next_pol(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data);
+int next_pols(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+	      int *Q, int max, int *num);
+void ps_frontier(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		 int level,
+		 void (*emit)(void *arg, ps_dynamic_data_t *dy_data,
+			      ps_dynamic_data_t *shard, int escape),
+		 void *arg);
+int ps_estimate(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+		long probes, ulong seed, int flags, ps_estimate_t *res);
+long ps_sample(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+	       long num, ulong seed, int flags, double bound, long max_probes,
+	       int num_threads, int *Q, double *weights,
+	       ps_sample_stats_t *res);
+void ps_static_fprint(FILE *f, ps_static_data_t *st_data);
+void ps_dynamic_fprint(FILE *f, ps_dynamic_data_t *dy_data);
+ps_dynamic_data_t *ps_dynamic_fread(FILE *f, int d);
+void ps_dynamic_restore(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data);
 
+#endif
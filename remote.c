@@ -0,0 +1,568 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "remote.h"
+
+/* Distributed search over sockets, between one coordinator and any
+   number of worker processes, on one machine or several.
+
+   The coordinator hands subtrees (as written by ps_dynamic_fprint) to
+   the workers, one each. A worker searches its subtree in one thread,
+   streaming the solutions back, and reports the node count once done.
+   Whenever a worker is idle and no subtree is left, the coordinator asks
+   a busy worker to split its subtree with ps_dynamic_split, as in the
+   work-stealing pool (see work_stealing.c), and hands the piece sent
+   back to the idle worker. Run one worker per core.
+
+   The address is either host:port, for TCP, or the path of a Unix-domain
+   socket. Workers may be started before the coordinator, and may join
+   while the search is running.
+
+   The protocol is plain text, one message per line. The coordinator
+   first sends
+     root-unitary remote 1
+   the static data as written by ps_static_fprint, and
+     sturm_bisect hankel filter
+   and then, at any time,
+     t state          a subtree to search (only to an idle worker)
+     split            a request to split the current subtree
+     stop             the end of the search
+   A worker answers each split with either
+     p state          the piece split off
+     n                nothing to split (or no subtree)
+   and otherwise sends
+     s c_0 ... c_2d+2 a solution (as in extract_symmetrized_pol)
+     d count          the count of its subtree, once exhausted
+     l count          the same, if the node count was reached
+
+   The node count applies to each subtree handed out, as in a batch of
+   the work-stealing pool. A worker which disconnects while holding a
+   subtree makes the search fail, as its solutions cannot be told apart
+   from those of a rerun.
+*/
+
+#define REMOTE_MAGIC "root-unitary remote"
+#define REMOTE_VERSION 1
+
+/* Seconds to wait before asking a worker again after it had nothing to
+   split, and for the coordinator to come up. */
+#define REMOTE_RETRY 0.01
+#define REMOTE_CONNECT 10.0
+
+static double remote_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec + ts.tv_nsec*1e-9);
+}
+
+/* Return 1 if address is the path of a Unix-domain socket. */
+static int remote_is_unix(const char *address) {
+  return(strchr(address, ':') == NULL || strchr(address, '/') != NULL);
+}
+
+/* Return a socket listening on (if listening) or connected to address,
+   or -1 on failure. */
+static int remote_socket(const char *address, int listening) {
+  struct sockaddr_un un;
+  struct addrinfo hints, *res, *ai;
+  const char *colon = strrchr(address, ':');
+  char *host;
+  int fd = -1, one = 1;
+
+  if (remote_is_unix(address)) {
+    if (strlen(address) >= sizeof(un.sun_path)) return(-1);
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strcpy(un.sun_path, address);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return(-1);
+    if (listening) {
+      unlink(address);
+      if (bind(fd, (struct sockaddr *)&un, sizeof(un)) == 0 &&
+	  listen(fd, 64) == 0)
+	return(fd);
+    } else if (connect(fd, (struct sockaddr *)&un, sizeof(un)) == 0)
+      return(fd);
+    close(fd);
+    return(-1);
+  }
+
+  host = strndup(address, colon - address);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (listening) hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(*host ? host : NULL, colon+1, &hints, &res) != 0) {
+    free(host);
+    return(-1);
+  }
+  free(host);
+  for (ai=res; ai!=NULL; ai=ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    if (listening) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0)
+	break;
+    } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return(fd);
+}
+
+/* Parse a state from the rest of a message. */
+static ps_dynamic_data_t *remote_state(const char *s, int d) {
+  ps_dynamic_data_t *dy_data;
+  FILE *f = fmemopen((void *)s, strlen(s), "r");
+  if (f == NULL) return(NULL);
+  dy_data = ps_dynamic_fread(f, d);
+  fclose(f);
+  return(dy_data);
+}
+
+/* A connection, as seen by the coordinator. */
+typedef struct remote_worker {
+  int fd;
+  FILE *out;
+  char *buf;         /* input not yet parsed */
+  size_t len, size;
+  int busy;          /* holding a subtree */
+  int asked;         /* a split request is outstanding */
+  double retry;      /* when the worker may be asked again */
+} remote_worker_t;
+
+typedef struct remote_coordinator {
+  ps_static_data_t *st_data;
+  remote_worker_t *workers;
+  int num_workers;
+  ps_dynamic_data_t **queue;
+  int num_queued, size;
+  FILE *out;
+  long count, solutions;
+  int failed;
+} remote_coordinator_t;
+
+static void remote_push(remote_coordinator_t *c, ps_dynamic_data_t *dy_data) {
+  if (c->num_queued == c->size) {
+    c->size = 2*c->size + 16;
+    c->queue = (ps_dynamic_data_t **)realloc(c->queue,
+				     c->size*sizeof(ps_dynamic_data_t *));
+  }
+  c->queue[c->num_queued++] = dy_data;
+}
+
+/* Send a message; a worker which cannot be written to is dropped. */
+static int remote_send(remote_coordinator_t *c, remote_worker_t *w,
+		       const char *msg, ps_dynamic_data_t *dy_data) {
+  fputs(msg, w->out);
+  if (dy_data != NULL) ps_dynamic_fprint(w->out, dy_data);
+  if (fflush(w->out) == 0) return(1);
+  if (w->busy || w->asked) c->failed = 1;
+  fclose(w->out);
+  w->fd = -1;
+  return(0);
+}
+
+/* Handle one message from a worker; return 0 if it is malformed. */
+static int remote_handle(remote_coordinator_t *c, remote_worker_t *w,
+			 char *line) {
+  int d = c->st_data->d, i;
+  ps_dynamic_data_t *dy_data;
+  long x;
+  char *s;
+
+  switch (line[0]) {
+  case 's':
+    for (i=0, s=line+1; i<=2*d+2; i++) {
+      x = strtol(s, &s, 10);
+      fprintf(c->out, i ? ", %ld" : "[%ld", x);
+    }
+    fprintf(c->out, "]\n");
+    c->solutions += 1;
+    return(1);
+  case 'p':
+    dy_data = remote_state(line+1, d);
+    if (dy_data == NULL) return(0);
+    remote_push(c, dy_data);
+    w->asked = 0;
+    return(1);
+  case 'n':
+    w->asked = 0;
+    w->retry = remote_time() + REMOTE_RETRY;
+    return(1);
+  case 'l':
+    c->failed = 1;
+    /* fall through */
+  case 'd':
+    if (sscanf(line+1, "%ld", &x) != 1) return(0);
+    c->count += x;
+    w->busy = 0;
+    return(1);
+  }
+  return(0);
+}
+
+/* Read what a worker sent and handle the complete messages; return 0 if
+   the connection is closed or broken. */
+static int remote_receive(remote_coordinator_t *c, remote_worker_t *w) {
+  ssize_t r;
+  char *line, *end;
+
+  if (w->size - w->len < 4096) {
+    w->size = 2*w->size + 4096;
+    w->buf = (char *)realloc(w->buf, w->size);
+  }
+  r = read(w->fd, w->buf + w->len, w->size - w->len - 1);
+  if (r <= 0) return(0);
+  w->len += r;
+  w->buf[w->len] = '\0';
+  line = w->buf;
+  while ((end = strchr(line, '\n')) != NULL) {
+    *end = '\0';
+    if (!remote_handle(c, w, line)) return(0);
+    line = end+1;
+  }
+  w->len -= line - w->buf;
+  memmove(w->buf, line, w->len);
+  return(1);
+}
+
+/* Search the subtrees states[0], ..., states[num_states-1] (which are not
+   modified) on the workers connecting to address, writing the solutions
+   to out as lists of 2*d+3 coefficients, in no particular order. Set
+   count and solutions to the totals, including the counts the states
+   start with. Return 1 on success, 0 if the node count was reached in
+   some subtree, a worker holding a subtree was lost, or the address
+   cannot be listened on. */
+int ps_coordinator_run(const char *address, ps_static_data_t *st_data,
+		       ps_dynamic_data_t **states, int num_states, FILE *out,
+		       long *count, long *solutions) {
+  remote_coordinator_t c;
+  remote_worker_t *w;
+  struct pollfd *fds;
+  int i, j, fd, lfd, busy, idle, asked, nfds;
+  double now;
+
+  /* A broken connection shows up as a failed write instead. */
+  signal(SIGPIPE, SIG_IGN);
+  *count = *solutions = 0;
+  lfd = remote_socket(address, 1);
+  if (lfd < 0) return(0);
+  c.st_data = st_data;
+  c.workers = NULL;
+  c.num_workers = 0;
+  c.queue = NULL;
+  c.num_queued = c.size = 0;
+  c.out = out;
+  c.count = c.solutions = 0;
+  c.failed = 0;
+  for (i=num_states-1; i>=0; i--)
+    remote_push(&c, ps_dynamic_clone(states[i]));
+  fds = NULL;
+
+  while (!c.failed) {
+    /* Hand out the subtrees, then ask for more if some worker is idle. */
+    busy = idle = asked = 0;
+    for (i=0; i<c.num_workers; i++) {
+      w = c.workers+i;
+      if (w->fd < 0) continue;
+      if (!w->busy && c.num_queued > 0 &&
+	  remote_send(&c, w, "t ", c.queue[c.num_queued-1])) {
+	ps_dynamic_clear(c.queue[--c.num_queued]);
+	w->busy = 1;
+      }
+      if (w->fd < 0) continue;
+      if (w->busy) busy += 1;
+      else idle += 1;
+      if (w->asked) asked += 1;
+    }
+    if (busy == 0 && c.num_queued == 0) break;
+    now = remote_time();
+    for (i=0; i<c.num_workers && asked < idle; i++) {
+      w = c.workers+i;
+      if (w->fd >= 0 && w->busy && !w->asked && now >= w->retry &&
+	  remote_send(&c, w, "split\n", NULL)) {
+	w->asked = 1;
+	asked += 1;
+      }
+    }
+
+    fds = (struct pollfd *)realloc(fds, (c.num_workers+1)*sizeof(struct pollfd));
+    fds[0].fd = lfd;
+    fds[0].events = POLLIN;
+    for (i=0; i<c.num_workers; i++) {
+      fds[i+1].fd = c.workers[i].fd;
+      fds[i+1].events = POLLIN;
+    }
+    nfds = c.num_workers+1;
+    if (poll(fds, nfds, (int)(1000*REMOTE_RETRY)) < 0) continue;
+
+    for (i=1; i<nfds; i++) {
+      w = c.workers+i-1;
+      if (w->fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+	continue;
+      if (!remote_receive(&c, w)) {
+	if (w->busy || w->asked) c.failed = 1;
+	fclose(w->out);
+	w->fd = -1;
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      fd = accept(lfd, NULL, NULL);
+      if (fd < 0) continue;
+      /* Reuse the slot of a closed connection, if any. */
+      for (j=0; j<c.num_workers && c.workers[j].fd >= 0; j++);
+      if (j == c.num_workers) {
+	c.workers = (remote_worker_t *)realloc(c.workers,
+			       (c.num_workers+1)*sizeof(remote_worker_t));
+	c.workers[j].buf = NULL;
+	c.num_workers += 1;
+      }
+      w = c.workers+j;
+      w->fd = fd;
+      w->out = fdopen(fd, "w");
+      w->len = w->size = 0;
+      w->busy = w->asked = 0;
+      w->retry = 0.0;
+      fprintf(w->out, "%s %d\n", REMOTE_MAGIC, REMOTE_VERSION);
+      ps_static_fprint(w->out, st_data);
+      fprintf(w->out, "%d %d %d\n", st_data->sturm_bisect, st_data->hankel,
+	      st_data->filter);
+      if (fflush(w->out) != 0) {
+	fclose(w->out);
+	w->fd = -1;
+      }
+    }
+  }
+
+  for (i=0; i<c.num_workers; i++) {
+    w = c.workers+i;
+    if (w->fd >= 0) {
+      fputs("stop\n", w->out);
+      fclose(w->out);
+    }
+    free(w->buf);
+  }
+  for (i=0; i<c.num_queued; i++)
+    ps_dynamic_clear(c.queue[i]);
+  free(c.queue);
+  free(c.workers);
+  free(fds);
+  close(lfd);
+  if (remote_is_unix(address)) unlink(address);
+  if (fflush(out) != 0) c.failed = 1;
+  *count = c.count;
+  *solutions = c.solutions;
+  return(!c.failed);
+}
+
+/* A worker: the messages from the coordinator are read by a thread of
+   their own, which passes them on to the search through the interrupt
+   flag of its state. */
+typedef struct remote_inbox {
+  FILE *in;
+  int d;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  ps_dynamic_data_t *state; /* the subtree to search next */
+  int split, stop;
+  int finished;             /* the coordinator sent stop */
+  int interrupt;
+} remote_inbox_t;
+
+static void *remote_reader(void *arg) {
+  remote_inbox_t *box = (remote_inbox_t *)arg;
+  ps_dynamic_data_t *dy_data = NULL;
+  char *line = NULL;
+  size_t size = 0;
+  int split, stop, finished;
+
+  while (1) {
+    split = stop = finished = 0;
+    if (getline(&line, &size, box->in) < 0) stop = 1;
+    else if (strncmp(line, "t ", 2) == 0) {
+      dy_data = remote_state(line+2, box->d);
+      if (dy_data == NULL) stop = 1;
+    } else if (strcmp(line, "split\n") == 0) split = 1;
+    else {
+      stop = 1;
+      finished = (strcmp(line, "stop\n") == 0);
+    }
+    pthread_mutex_lock(&box->lock);
+    box->finished |= finished;
+    if (dy_data != NULL) box->state = dy_data;
+    box->split |= split;
+    box->stop |= stop;
+    if (split || stop)
+      __atomic_store_n(&box->interrupt, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&box->cond);
+    pthread_mutex_unlock(&box->lock);
+    dy_data = NULL;
+    if (stop) break;
+  }
+  free(line);
+  return(NULL);
+}
+
+/* Read the static data sent by the coordinator. */
+static ps_static_data_t *remote_static(FILE *f) {
+  ps_static_data_t *st_data = NULL;
+  int d, lead, sign, q, cofactor, verbosity, version, i;
+  int bisect, hankel, filter;
+  int *modlist = NULL, *point_count = NULL, *newton = NULL;
+  long node_count;
+  char magic[64];
+
+  if (fgets(magic, sizeof(magic), f) == NULL ||
+      strncmp(magic, REMOTE_MAGIC, strlen(REMOTE_MAGIC)) != 0 ||
+      sscanf(magic + strlen(REMOTE_MAGIC), "%d", &version) != 1 ||
+      version != REMOTE_VERSION ||
+      fscanf(f, "%d %d %d %d %d %d %ld", &d, &lead, &sign, &q, &cofactor,
+	     &verbosity, &node_count) != 7 || d < 0)
+    return(NULL);
+  modlist = (int *)malloc((d+1)*sizeof(int));
+  for (i=0; i<=d; i++)
+    if (fscanf(f, "%d", modlist+i) != 1) goto done;
+  if (fscanf(f, "%d", &i) != 1) goto done;
+  if (i) {
+    point_count = (int *)malloc(6*sizeof(int));
+    for (i=0; i<6; i++)
+      if (fscanf(f, "%d", point_count+i) != 1) goto done;
+  }
+  if (fscanf(f, "%d", &i) != 1) goto done;
+  if (i) {
+    newton = (int *)malloc((2*d+1)*sizeof(int));
+    for (i=0; i<=2*d; i++)
+      if (fscanf(f, "%d", newton+i) != 1) goto done;
+  }
+  /* Also consume the end of the line. */
+  if (fscanf(f, "%d %d %d%*[^\n]", &bisect, &hankel, &filter) != 3 ||
+      fgetc(f) != '\n')
+    goto done;
+  st_data = ps_static_init(d, lead, sign, q, cofactor, modlist, verbosity,
+			   node_count, point_count, newton);
+  ps_static_set_sturm_bisect(st_data, bisect);
+  ps_static_set_hankel(st_data, hankel);
+  ps_static_set_filter(st_data, filter);
+
+ done:
+  free(modlist);
+  free(point_count);
+  free(newton);
+  return(st_data);
+}
+
+/* Work for the coordinator at address until it stops. Return 1 once the
+   search is over (possibly before this worker joined), 0 if the
+   coordinator cannot be reached or the connection is broken. */
+int ps_remote_worker_run(const char *address) {
+  remote_inbox_t box;
+  ps_static_data_t *st_data;
+  ps_dynamic_data_t *dy_data, *dy_data2;
+  pthread_t reader;
+  double start = remote_time();
+  int fd, d, i, t, *Q;
+  FILE *out;
+
+  signal(SIGPIPE, SIG_IGN);
+  while ((fd = remote_socket(address, 0)) < 0) {
+    if (remote_time() - start > REMOTE_CONNECT) return(0);
+    usleep(100000);
+  }
+  box.in = fdopen(fd, "r");
+  out = fdopen(dup(fd), "w");
+  /* A connection closed at once is from a search already over. */
+  t = fgetc(box.in);
+  st_data = (t == EOF) ? NULL : (ungetc(t, box.in), remote_static(box.in));
+  if (st_data == NULL) {
+    fclose(box.in);
+    fclose(out);
+    return(t == EOF);
+  }
+  d = box.d = st_data->d;
+  pthread_mutex_init(&box.lock, NULL);
+  pthread_cond_init(&box.cond, NULL);
+  box.state = NULL;
+  box.split = box.stop = box.finished = box.interrupt = 0;
+  pthread_create(&reader, NULL, remote_reader, &box);
+  Q = (int *)malloc((2*d+3)*sizeof(int));
+
+  while (1) {
+    /* Wait for a subtree, answering any split request meanwhile. */
+    pthread_mutex_lock(&box.lock);
+    while (!box.stop && !box.split && box.state == NULL)
+      pthread_cond_wait(&box.cond, &box.lock);
+    if (box.split) {
+      box.split = 0;
+      pthread_mutex_unlock(&box.lock);
+      fprintf(out, "n\n");
+      if (fflush(out) != 0) break;
+      continue;
+    }
+    dy_data = box.state;
+    box.state = NULL;
+    __atomic_store_n(&box.interrupt, box.stop, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&box.lock);
+    if (dy_data == NULL) break;
+
+    ps_dynamic_restore(st_data, dy_data);
+    dy_data->interrupt = &box.interrupt;
+    while ((t = next_pol(st_data, dy_data)) != 0 && t != -1) {
+      if (t > 0) {
+	extract_symmetrized_pol(Q, dy_data);
+	fprintf(out, "s");
+	for (i=0; i<=2*d+2; i++) fprintf(out, " %d", Q[i]);
+	fprintf(out, "\n");
+	continue;
+      }
+      pthread_mutex_lock(&box.lock);
+      __atomic_store_n(&box.interrupt, 0, __ATOMIC_RELAXED);
+      t = box.stop;
+      i = box.split;
+      box.split = 0;
+      pthread_mutex_unlock(&box.lock);
+      if (t) break;
+      if (i) {
+	dy_data2 = ps_dynamic_split(dy_data);
+	if (dy_data2 == NULL) fprintf(out, "n\n");
+	else {
+	  fprintf(out, "p ");
+	  ps_dynamic_fprint(out, dy_data2);
+	  ps_dynamic_clear(dy_data2);
+	}
+	fflush(out);
+      }
+    }
+    if (t == 0) fprintf(out, "d %ld\n", extract_count(dy_data));
+    else if (t == -1) fprintf(out, "l %ld\n", extract_count(dy_data));
+    ps_dynamic_clear(dy_data);
+    if (fflush(out) != 0 || t > 0) break;
+  }
+
+  /* Closing the connection ends the reader, if it is still running. */
+  shutdown(fd, SHUT_RDWR);
+  pthread_join(reader, NULL);
+  pthread_mutex_lock(&box.lock);
+  t = box.finished;
+  pthread_mutex_unlock(&box.lock);
+  fclose(box.in);
+  fclose(out);
+  if (box.state != NULL) ps_dynamic_clear(box.state);
+  pthread_mutex_destroy(&box.lock);
+  pthread_cond_destroy(&box.cond);
+  ps_static_clear(st_data);
+  free(Q);
+  return(t);
+}
@@ -0,0 +1,12 @@
+#ifndef REMOTE
+#define REMOTE
+
+#include <stdio.h>
+#include "power_sums.h"
+
+int ps_coordinator_run(const char *address, ps_static_data_t *st_data,
+		       ps_dynamic_data_t **states, int num_states, FILE *out,
+		       long *count, long *solutions);
+int ps_remote_worker_run(const char *address);
+
+#endif
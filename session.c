@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "session.h"
+
+/* Refinement sessions, for a sequence of searches each restricting the
+   one before, as when the modulus is raised step by step or more leading
+   coefficients are fixed (see search-test.sage).
+
+   A search run through a session is split at the frontier at the
+   session's depth, as by ps_frontier: each successful node at level
+   level+1 makes up a shard, its children, which is searched with
+   next_pol. The session then keeps the paths to the shards which had
+   solutions, in a trie.
+
+   If the next search refines the last one, i.e., each modulus is a
+   multiple of the previous one (or 0), Q0 lies in the same classes
+   (or is equal where the modulus was 0), the leaf filters are at least
+   as strict and the other parameters are the same, then each of its
+   solutions was one of the last search. It therefore only walks down the
+   paths in the trie, checking each node again with the new parameters
+   (set_range_from_power_sums does not depend on the modulus, except for
+   rounding to its class), and searches the shards it reaches; the pruned
+   parts of the tree are not enumerated again. Otherwise, the whole tree
+   is searched. Either way, the trie is then replaced by the paths of the
+   new search.
+
+   The solutions come in the same order as from next_pol. The node count
+   is that of the nodes visited; as the aborts reaching across shards are
+   not followed (see ps_frontier), it can be slightly higher than that of
+   next_pol for a whole search.
+
+   Searches with newton_advance (which ps_dynamic_select does not apply)
+   are always run on the whole tree, and are not refined.
+*/
+
+ps_session_t *ps_session_init(int depth) {
+  ps_session_t *s;
+
+  s = (ps_session_t *)calloc(1, sizeof(ps_session_t));
+  s->depth = depth;
+  return(s);
+}
+
+static void ps_session_forget(ps_session_t *s) {
+  free(s->Q0);
+  free(s->modlist);
+  free(s->point_count);
+  free(s->trie.n);
+  free(s->trie.val);
+  s->Q0 = s->modlist = NULL;
+  s->point_count = NULL;
+  memset(&s->trie, 0, sizeof(ps_trie_t));
+  s->valid = 0;
+}
+
+void ps_session_clear(ps_session_t *s) {
+  ps_session_forget(s);
+  free(s);
+}
+
+/* The number of nodes in the trie. */
+long ps_session_size(ps_session_t *s) {
+  return(s->trie.len);
+}
+
+static void ps_trie_push(ps_trie_t *t, int n, slong c) {
+  if (t->len == t->alloc) {
+    t->alloc = 2*t->alloc + 64;
+    t->n = (int *)realloc(t->n, t->alloc*sizeof(int));
+    t->val = (slong *)realloc(t->val, t->alloc*sizeof(slong));
+  }
+  t->n[t->len] = n;
+  t->val[t->len] = c;
+  t->len += 1;
+}
+
+/* Add the path pol[d], ..., pol[level+1], which comes after those already
+   in t in the order of next_pol; last holds the previous one. */
+static void ps_trie_add(ps_trie_t *t, const slong *pol, int d, int level,
+			slong *last) {
+  int m = d;
+
+  if (t->len > 0)
+    while (m > level && last[m] == pol[m]) m--;
+  for (; m > level; m--) {
+    last[m] = pol[m];
+    ps_trie_push(t, m, pol[m]);
+  }
+}
+
+/* Return 1 if the search from dy_data refines the last one. */
+static int ps_session_refines(ps_session_t *s, ps_static_data_t *st_data,
+			      ps_dynamic_data_t *dy_data, int level) {
+  int i, d = st_data->d;
+  slong m, m2, c;
+
+  if (!s->valid || s->d != d || s->level != level ||
+      s->lead != st_data->lead || s->sign != st_data->sign ||
+      s->q != st_data->q || (s->filter & ~st_data->filter) ||
+      st_data->newton != NULL ||
+      (s->point_count == NULL) != (st_data->point_count == NULL))
+    return(0);
+  for (i=0; i<3; i++)
+    if (s->cofactor[i] != fmpz_get_si(st_data->cofactor+i)) return(0);
+  if (s->point_count != NULL)
+    for (i=0; i<6; i++)
+      if (s->point_count[i] != st_data->point_count[i]) return(0);
+  for (i=0; i<=d; i++) {
+    m = s->modlist[i];
+    m2 = fmpz_get_si(st_data->modlist+i);
+    c = fmpz_get_si(dy_data->pol+i) - s->Q0[i];
+    if (m == 0 ? (m2 != 0 || c != 0) : (m2 % m != 0 || c % m != 0))
+      return(0);
+  }
+  return(1);
+}
+
+/* Record the parameters of the search from dy_data. */
+static void ps_session_record(ps_session_t *s, ps_static_data_t *st_data,
+			      ps_dynamic_data_t *dy_data, int level) {
+  int i, d = st_data->d;
+
+  s->d = d;
+  s->lead = st_data->lead;
+  s->sign = st_data->sign;
+  s->q = st_data->q;
+  s->filter = st_data->filter;
+  s->level = level;
+  for (i=0; i<3; i++) s->cofactor[i] = fmpz_get_si(st_data->cofactor+i);
+  s->Q0 = (slong *)malloc((d+1)*sizeof(slong));
+  s->modlist = (slong *)malloc((d+1)*sizeof(slong));
+  for (i=0; i<=d; i++) {
+    s->Q0[i] = fmpz_get_si(dy_data->pol+i);
+    s->modlist[i] = fmpz_get_si(st_data->modlist+i);
+  }
+  if (st_data->point_count != NULL) {
+    s->point_count = (int *)malloc(6*sizeof(int));
+    memcpy(s->point_count, st_data->point_count, 6*sizeof(int));
+  }
+  s->valid = (st_data->newton == NULL);
+}
+
+/* State of ps_session_search. */
+typedef struct session_search {
+  ps_session_t *s;
+  ps_static_data_t *st_data;
+  ps_dynamic_data_t *root;
+  void (*emit)(void *arg, ps_dynamic_data_t *dy_data);
+  void *arg;
+  long *count, *solutions;
+  int level, stop;
+  ps_trie_t trie;
+  slong *path, *last;
+} session_search_t;
+
+/* Search a shard, then free it. */
+static void session_run(session_search_t *ss, ps_dynamic_data_t *shard) {
+  int d = ss->st_data->d, m, t;
+  long found = 0;
+
+  if (!ss->stop) {
+    for (m=ss->level+1; m<=d; m++) ss->path[m] = fmpz_get_si(shard->pol+m);
+    while ((t = next_pol(ss->st_data, shard)) > 0) {
+      ss->emit(ss->arg, shard);
+      found += 1;
+    }
+    found += shard->solutions;
+    *ss->count += shard->count;
+    *ss->solutions += found;
+    if (t < 0) ss->stop = 1;
+    else if (found > 0)
+      ps_trie_add(&ss->trie, ss->path, d, ss->level, ss->last);
+  }
+  ps_dynamic_clear(shard);
+}
+
+/* The callback of ps_frontier, for a search of the whole tree. */
+static void session_visit(void *arg, ps_dynamic_data_t *node,
+			  ps_dynamic_data_t *shard, int escape) {
+  session_search_t *ss = (session_search_t *)arg;
+
+  (void)node;
+  (void)escape; /* the aborts reaching across shards are not followed */
+  if (shard == NULL) *ss->count += 1;
+  else session_run(ss, shard);
+}
+
+/* Visit the node of the trie of the session at *j, whose value has been
+   selected in ss->root, and those below it; *j then points past them. */
+static void session_walk(session_search_t *ss, long *j) {
+  ps_trie_t *t = &ss->s->trie;
+  ps_dynamic_data_t *root = ss->root;
+  int m = t->n[*j], r;
+
+  *j += 1;
+  root->n = m;
+  r = set_range_from_power_sums(ss->st_data, root);
+  if (r <= 0) *ss->count += 1;
+  else if (m == ss->level+1)
+    session_run(ss, ps_dynamic_shard(root, ss->level));
+  while (*j < t->len && t->n[*j] == m-1) {
+    if (r > 0 && ps_dynamic_select(ss->st_data, root, m, t->val[*j]))
+      session_walk(ss, j);
+    else
+      for (*j += 1; *j < t->len && t->n[*j] < m-1; *j += 1);
+  }
+}
+
+/* Search the tree below dy_data, which must not have been started (and
+   is left alone), through the session s. Call emit for each solution,
+   in the order of next_pol, with the state holding it (as for
+   extract_symmetrized_pol), and add the node count and the number of
+   solutions to *count and *solutions (in count-only mode, the solutions
+   are only counted). Return 1 if the search refined the last one, 0 if
+   it covered the whole tree, and -1 if the node limit was reached (the
+   session then forgets the last search) or dy_data was started. */
+int ps_session_search(ps_session_t *s, ps_static_data_t *st_data,
+		      ps_dynamic_data_t *dy_data,
+		      void (*emit)(void *arg, ps_dynamic_data_t *dy_data),
+		      void *arg, long *count, long *solutions) {
+  int d = st_data->d, refine, level;
+  session_search_t ss;
+  long j = 0;
+
+  if (dy_data->n != d || dy_data->ascend != 0) return(-1);
+  level = (s->depth <= 0 || s->depth > d) ? 0 : d - s->depth;
+  ss.s = s;
+  ss.st_data = st_data;
+  ss.emit = emit;
+  ss.arg = arg;
+  ss.count = count;
+  ss.solutions = solutions;
+  ss.level = level;
+  ss.stop = 0;
+  memset(&ss.trie, 0, sizeof(ps_trie_t));
+  ss.path = (slong *)malloc((d+1)*sizeof(slong));
+  ss.last = (slong *)malloc((d+1)*sizeof(slong));
+  ss.root = ps_dynamic_clone(dy_data);
+  refine = ps_session_refines(s, st_data, dy_data, level);
+  if (!refine) ps_frontier(st_data, ss.root, level, session_visit, &ss);
+  else if (s->trie.len > 0 &&
+	   s->trie.val[0] == fmpz_get_si(ss.root->pol+d))
+    session_walk(&ss, &j);
+  ps_dynamic_clear(ss.root);
+  free(ss.path);
+  free(ss.last);
+
+  ps_session_forget(s);
+  if (ss.stop) {
+    free(ss.trie.n);
+    free(ss.trie.val);
+    return(-1);
+  }
+  s->trie = ss.trie;
+  ps_session_record(s, st_data, dy_data, level);
+  return(refine);
+}
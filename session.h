@@ -0,0 +1,35 @@
+#ifndef SESSION
+#define SESSION
+
+#include "power_sums.h"
+
+/* Paths down the tree, pol[d], ..., pol[level+1], as a trie: its nodes
+   are listed as (level, value) in the order in which next_pol visits
+   them, each followed by its children. */
+typedef struct ps_trie {
+  long len, alloc;
+  int *n;
+  slong *val;
+} ps_trie_t;
+
+/* The parameters of the last search run through a session, and the paths
+   to its shards which had solutions (see session.c). */
+typedef struct ps_session {
+  int depth;
+  int valid; /* whether the fields below describe the last search */
+  int d, lead, sign, q, filter, level;
+  slong cofactor[3];
+  slong *Q0, *modlist;
+  int *point_count;
+  ps_trie_t trie;
+} ps_session_t;
+
+ps_session_t *ps_session_init(int depth);
+void ps_session_clear(ps_session_t *s);
+long ps_session_size(ps_session_t *s);
+int ps_session_search(ps_session_t *s, ps_static_data_t *st_data,
+		      ps_dynamic_data_t *dy_data,
+		      void (*emit)(void *arg, ps_dynamic_data_t *dy_data),
+		      void *arg, long *count, long *solutions);
+
+#endif
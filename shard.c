@@ -0,0 +1,578 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "shard.h"
+
+/* Offline sharding, for searches spread over several machines.
+
+   A manifest lists the frontier of the tree at a given depth, as found
+   by ps_frontier: the nodes down to level level+1, in the order in which
+   next_pol visits them, with the children of each successful node at
+   level level+1 making up a shard. Each shard comes with an estimate of
+   its size (see ps_estimate), and the order of the shards by estimate is
+   stored, from which ps_manifest_assign deals them out to any number of
+   parts, balancing the estimates. Each part is searched
+   separately with ps_shard_run, writing the solutions and node count of
+   each of its shards to a results file, and ps_shard_merge puts the
+   results files together.
+
+   The merge replays the frontier in order, so that its output and node
+   count are exactly those of a single next_pol run over the whole tree.
+   This requires some care with aborts which skip more than the siblings
+   of a node (r < -2 in next_pol), as these can reach across shards: the
+   level at which next_pol carries on after such an abort (the escape
+   level) is recorded, for the failed nodes in the manifest and for the
+   shards in the results, and the merge then drops the entries which
+   next_pol would have skipped.
+
+   Manifest files are plain text:
+
+     root-unitary manifest 1
+   the static data as written by ps_static_fprint,
+     sturm_bisect hankel filter
+     level
+   then one line per entry, either
+     s estimate
+   followed by the shard as written by ps_dynamic_fprint, or
+     f n escape pol[n] ... pol[d]
+   for a failed node, then the indices of the shards among the entries,
+   by decreasing estimate (by index among equal ones),
+     o j_1 ... j_S
+   and finally
+     end
+   Version 1 manifests lack the o line; the order is then computed on
+   reading.
+
+   Results files are plain text:
+
+     root-unitary shard results 1
+     num_items part num_parts
+   then for each shard, in any order,
+     item index count escape num_solutions
+   followed by the solutions, one per line, as lists of 2*d+3
+   coefficients (as in process_queue.parallel_exhaust).
+*/
+
+#define MANIFEST_MAGIC "root-unitary manifest"
+#define MANIFEST_VERSION 2
+#define RESULTS_MAGIC "root-unitary shard results"
+#define RESULTS_VERSION 1
+
+/* Number of probes used by ps_manifest_write, if none are given. */
+#define MANIFEST_PROBES 16
+
+static void fprint_path(FILE *f, ps_dynamic_data_t *dy_data, int n) {
+  int i;
+  for (i=n; i<=dy_data->d; i++) {
+    fprintf(f, " ");
+    fmpz_fprint(f, dy_data->pol+i);
+  }
+  fprintf(f, "\n");
+}
+
+/* A shard, for sorting by estimate. */
+typedef struct shard_rank {
+  long index;
+  double estimate;
+} shard_rank_t;
+
+/* Decreasing estimate, then increasing index. */
+static int shard_rank_cmp(const void *a, const void *b) {
+  const shard_rank_t *x = (const shard_rank_t *)a;
+  const shard_rank_t *y = (const shard_rank_t *)b;
+  if (x->estimate != y->estimate) return(x->estimate > y->estimate ? -1 : 1);
+  return((x->index > y->index) - (x->index < y->index));
+}
+
+/* State of ps_manifest_write, for manifest_emit. */
+typedef struct manifest_writer {
+  FILE *f;
+  ps_static_data_t *st_data;
+  long probes, num_shards, num_items;
+  ps_estimate_t est;
+  shard_rank_t *ranks;
+} manifest_writer_t;
+
+/* The callback of ps_frontier for ps_manifest_write. */
+static void manifest_emit(void *arg, ps_dynamic_data_t *node,
+			  ps_dynamic_data_t *shard, int escape) {
+  manifest_writer_t *w = (manifest_writer_t *)arg;
+
+  w->num_items += 1;
+  if (shard == NULL) {
+    fprintf(w->f, "f %d %d", node->n, escape);
+    fprint_path(w->f, node, node->n);
+    return;
+  }
+  ps_estimate(w->st_data, shard, w->probes, w->num_shards,
+	      PS_ESTIMATE_WEIGHTED, &w->est);
+  fprintf(w->f, "s %.17g ", w->est.nodes);
+  ps_dynamic_fprint(w->f, shard);
+  ps_dynamic_clear(shard);
+  /* Grow ranks at powers of 2. */
+  if ((w->num_shards & (w->num_shards-1)) == 0)
+    w->ranks = (shard_rank_t *)realloc(w->ranks, 2*(w->num_shards+1)*
+				       sizeof(shard_rank_t));
+  w->ranks[w->num_shards].index = w->num_items-1;
+  w->ranks[w->num_shards].estimate = w->est.nodes;
+  w->num_shards += 1;
+}
+
+/* Write the manifest for the tree below dy_data, which must not have been
+   started, with the shards at depth levels below the root (1 <= depth
+   <= d); each shard is estimated from probes probes. dy_data is left
+   alone. Return the number of shards, or -1 on failure. */
+long ps_manifest_write(const char *filename, ps_static_data_t *st_data,
+		       ps_dynamic_data_t *dy_data, int depth, long probes) {
+  int d = st_data->d, level = d - depth;
+  manifest_writer_t w;
+  ps_dynamic_data_t *root;
+  char *tmpname;
+  FILE *f;
+  long j;
+  int r;
+
+  if (depth < 1 || depth > d || dy_data->ascend != 0) return(-1);
+  if (probes <= 0) probes = MANIFEST_PROBES;
+  tmpname = (char *)malloc(strlen(filename)+5);
+  sprintf(tmpname, "%s.tmp", filename);
+  f = fopen(tmpname, "w");
+  if (f == NULL) {
+    free(tmpname);
+    return(-1);
+  }
+  fprintf(f, "%s %d\n", MANIFEST_MAGIC, MANIFEST_VERSION);
+  ps_static_fprint(f, st_data);
+  fprintf(f, "%d %d %d\n%d\n", st_data->sturm_bisect, st_data->hankel,
+	  st_data->filter, level);
+  w.f = f;
+  w.st_data = st_data;
+  w.probes = probes;
+  w.num_shards = 0;
+  w.num_items = 0;
+  w.ranks = NULL;
+  root = ps_dynamic_clone(dy_data);
+  ps_frontier(st_data, root, level, manifest_emit, &w);
+  ps_dynamic_clear(root);
+  qsort(w.ranks, w.num_shards, sizeof(shard_rank_t), shard_rank_cmp);
+  fprintf(f, "o");
+  for (j=0; j<w.num_shards; j++) fprintf(f, " %ld", w.ranks[j].index);
+  fprintf(f, "\nend\n");
+  free(w.ranks);
+  r = (fflush(f) == 0);
+  r = (fclose(f) == 0) && r;
+  if (r) r = (rename(tmpname, filename) == 0);
+  free(tmpname);
+  return(r ? w.num_shards : -1);
+}
+
+/* Return NULL if the file cannot be read. */
+ps_manifest_t *ps_manifest_read(const char *filename) {
+  FILE *f;
+  ps_manifest_t *m;
+  ps_manifest_item_t *item;
+  shard_rank_t *ranks;
+  char magic[64], kind[8], *seen;
+  long j, k, size = 0;
+  int i, version;
+
+  f = fopen(filename, "r");
+  if (f == NULL) return(NULL);
+  m = (ps_manifest_t *)malloc(sizeof(ps_manifest_t));
+  m->modlist = NULL;
+  m->point_count = NULL;
+  m->newton = NULL;
+  m->num_items = 0;
+  m->num_shards = 0;
+  m->items = NULL;
+  m->order = NULL;
+
+  if (fgets(magic, sizeof(magic), f) == NULL ||
+      strncmp(magic, MANIFEST_MAGIC, strlen(MANIFEST_MAGIC)) != 0 ||
+      sscanf(magic + strlen(MANIFEST_MAGIC), "%d", &version) != 1 ||
+      version < 1 || version > MANIFEST_VERSION ||
+      fscanf(f, "%d %d %d %d %d %d %ld", &m->d, &m->lead, &m->sign,
+	     &m->q, &m->cofactor, &m->verbosity, &m->node_count) != 7 ||
+      m->d < 0)
+    goto fail;
+  m->modlist = (int *)malloc((m->d+1)*sizeof(int));
+  for (i=0; i<=m->d; i++)
+    if (fscanf(f, "%d", m->modlist+i) != 1) goto fail;
+  if (fscanf(f, "%d", &i) != 1) goto fail;
+  if (i) {
+    m->point_count = (int *)malloc(6*sizeof(int));
+    for (i=0; i<6; i++)
+      if (fscanf(f, "%d", m->point_count+i) != 1) goto fail;
+  }
+  if (fscanf(f, "%d", &i) != 1) goto fail;
+  if (i) {
+    m->newton = (int *)malloc((2*m->d+1)*sizeof(int));
+    for (i=0; i<=2*m->d; i++)
+      if (fscanf(f, "%d", m->newton+i) != 1) goto fail;
+  }
+  if (fscanf(f, "%d %d %d %d", &m->sturm_bisect, &m->hankel, &m->filter,
+	     &m->level) != 4 || m->level < 0 || m->level >= m->d)
+    goto fail;
+
+  while (1) {
+    if (fscanf(f, "%7s", kind) != 1) goto fail;
+    if (strcmp(kind, "end") == 0) break;
+    if (strcmp(kind, "o") == 0 && m->order == NULL) {
+      /* The shards by estimate; each must be listed once. */
+      m->order = (long *)malloc((m->num_shards+1)*sizeof(long));
+      seen = (char *)calloc(m->num_items+1, 1);
+      for (k=0; k<m->num_shards; k++) {
+	if (fscanf(f, "%ld", &j) != 1 || j < 0 || j >= m->num_items ||
+	    m->items[j].state == NULL || seen[j]) {
+	  free(seen);
+	  goto fail;
+	}
+	seen[j] = 1;
+	m->order[k] = j;
+      }
+      free(seen);
+      continue;
+    }
+    if (m->order != NULL) goto fail;
+    if (m->num_items == size) {
+      size = 2*size + 16;
+      m->items = (ps_manifest_item_t *)realloc(m->items,
+					  size*sizeof(ps_manifest_item_t));
+    }
+    item = m->items + m->num_items;
+    item->path = NULL;
+    item->state = NULL;
+    item->estimate = 0.0;
+    m->num_items += 1;
+    if (strcmp(kind, "s") == 0) {
+      if (fscanf(f, "%lf", &item->estimate) != 1) goto fail;
+      item->state = ps_dynamic_fread(f, m->d);
+      if (item->state == NULL || item->state->n != m->level) goto fail;
+      item->n = m->level+1;
+      item->escape = -1;
+      item->path = (slong *)malloc((m->d-item->n+1)*sizeof(slong));
+      for (i=item->n; i<=m->d; i++)
+	item->path[i-item->n] = fmpz_get_si(item->state->pol+i);
+      m->num_shards += 1;
+    } else if (strcmp(kind, "f") == 0) {
+      if (fscanf(f, "%d %d", &item->n, &item->escape) != 2 ||
+	  item->n <= m->level || item->n > m->d)
+	goto fail;
+      item->path = (slong *)malloc((m->d-item->n+1)*sizeof(slong));
+      for (i=item->n; i<=m->d; i++)
+	if (fscanf(f, "%ld", item->path+i-item->n) != 1) goto fail;
+    } else goto fail;
+  }
+  if (m->order == NULL && version > 1) goto fail;
+  fclose(f);
+
+  if (m->order == NULL) {
+    ranks = (shard_rank_t *)malloc((m->num_shards+1)*sizeof(shard_rank_t));
+    for (j=0, k=0; j<m->num_items; j++)
+      if (m->items[j].state != NULL) {
+	ranks[k].index = j;
+	ranks[k].estimate = m->items[j].estimate;
+	k += 1;
+      }
+    qsort(ranks, m->num_shards, sizeof(shard_rank_t), shard_rank_cmp);
+    m->order = (long *)malloc((m->num_shards+1)*sizeof(long));
+    for (k=0; k<m->num_shards; k++) m->order[k] = ranks[k].index;
+    free(ranks);
+  }
+  return(m);
+
+ fail:
+  fclose(f);
+  ps_manifest_clear(m);
+  return(NULL);
+}
+
+/* Return the static data for the search, with the settings it was
+   written with, and restore the shards for it (see ps_dynamic_restore). */
+ps_static_data_t *ps_manifest_static(ps_manifest_t *m) {
+  ps_static_data_t *st_data;
+  long j;
+
+  st_data = ps_static_init(m->d, m->lead, m->sign, m->q, m->cofactor,
+			   m->modlist, m->verbosity, m->node_count,
+			   m->point_count, m->newton);
+  ps_static_set_sturm_bisect(st_data, m->sturm_bisect);
+  ps_static_set_hankel(st_data, m->hankel);
+  ps_static_set_filter(st_data, m->filter);
+  for (j=0; j<m->num_items; j++)
+    if (m->items[j].state != NULL)
+      ps_dynamic_restore(st_data, m->items[j].state);
+  return(st_data);
+}
+
+/* Whether part p has less load than part p2 (or as much, and p < p2). */
+static int load_less(const double *load, int p, int p2) {
+  return(load[p] < load[p2] || (load[p] == load[p2] && p < p2));
+}
+
+/* Deal the shards out to num_parts parts, setting part[j] for each
+   entry j of the manifest (-1 for failed nodes): the largest shard
+   (by estimate) goes first, each to the part with the least total so
+   far, kept at the top of a heap. This only depends on the manifest and
+   num_parts. */
+void ps_manifest_assign(ps_manifest_t *m, int num_parts, int *part) {
+  double *load;
+  int *heap, i, c, p, best;
+  long j;
+
+  load = (double *)calloc(num_parts, sizeof(double));
+  heap = (int *)malloc(num_parts*sizeof(int));
+  for (p=0; p<num_parts; p++) heap[p] = p;
+  for (j=0; j<m->num_items; j++) part[j] = -1;
+  for (j=0; j<m->num_shards; j++) {
+    best = heap[0];
+    part[m->order[j]] = best;
+    load[best] += m->items[m->order[j]].estimate;
+    /* Sift best down. */
+    for (i=0; (c = 2*i+1) < num_parts; i = c) {
+      if (c+1 < num_parts && load_less(load, heap[c+1], heap[c])) c += 1;
+      if (!load_less(load, heap[c], best)) break;
+      heap[i] = heap[c];
+    }
+    heap[i] = best;
+  }
+  free(heap);
+  free(load);
+}
+
+void ps_manifest_clear(ps_manifest_t *m) {
+  long j;
+  for (j=0; j<m->num_items; j++) {
+    free(m->items[j].path);
+    if (m->items[j].state != NULL) ps_dynamic_clear(m->items[j].state);
+  }
+  free(m->items);
+  free(m->order);
+  free(m->modlist);
+  free(m->point_count);
+  free(m->newton);
+  free(m);
+}
+
+/* After next_pol has exhausted a shard, return the level at which it
+   would carry on in the whole tree, if it is not the parent's next
+   sibling, and otherwise -1. Each level it stepped through on the way
+   out has pol above upper; a normal exit steps through the first level
+   above the shard with a nonzero modulus. */
+static int shard_escape(ps_static_data_t *st_data, ps_dynamic_data_t *dy_data,
+			int level) {
+  int m, first = -1;
+  for (m=level+1; m<=st_data->d; m++) {
+    if (fmpz_is_zero(st_data->modlist+m)) continue;
+    if (first < 0) first = m;
+    if (fmpz_cmp(dy_data->pol+m, dy_data->upper+m) > 0)
+      return(m == first ? -1 : m);
+  }
+  return(first < 0 ? -1 : st_data->d+1);
+}
+
+typedef struct shard_run {
+  ps_manifest_t *m;
+  ps_static_data_t *st_data;
+  long *list, num, next;
+  FILE *out;
+  pthread_mutex_t lock;
+  long count, solutions;
+  int ok;
+} shard_run_t;
+
+static void *shard_worker(void *arg) {
+  shard_run_t *run = (shard_run_t *)arg;
+  ps_static_data_t *st_data = run->st_data;
+  int d = st_data->d, i, t;
+  int *Q = (int *)malloc((2*d+3)*sizeof(int));
+  ps_dynamic_data_t *dy_data;
+  long j, num;
+  char *buf;
+  size_t len;
+  FILE *f;
+
+  while ((j = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED))
+	 < run->num) {
+    dy_data = run->m->items[run->list[j]].state;
+    /* Each shard is written as a single block, once done. */
+    f = open_memstream(&buf, &len);
+    num = 0;
+    while ((t = next_pol(st_data, dy_data)) > 0) {
+      extract_symmetrized_pol(Q, dy_data);
+      fprintf(f, "[");
+      for (i=0; i<=2*d+2; i++)
+	fprintf(f, i ? ", %d" : "%d", Q[i]);
+      fprintf(f, "]\n");
+      num += 1;
+    }
+    fclose(f);
+    pthread_mutex_lock(&run->lock);
+    if (t < 0) run->ok = 0;
+    else {
+      fprintf(run->out, "item %ld %ld %d %ld\n", run->list[j],
+	      extract_count(dy_data), shard_escape(st_data, dy_data,
+						   run->m->level), num);
+      if (fwrite(buf, 1, len, run->out) != len) run->ok = 0;
+      run->count += extract_count(dy_data);
+      run->solutions += num;
+    }
+    pthread_mutex_unlock(&run->lock);
+    free(buf);
+    if (t < 0) break;
+  }
+  free(Q);
+  return(NULL);
+}
+
+/* Search the shards of part part (0 <= part < num_parts) of the manifest,
+   as dealt out by ps_manifest_assign, on num_threads threads, each taking
+   whole shards; write the results file to out. Set count and solutions
+   to the totals over the part. Return 1 on success, 0 if the node count
+   was exceeded in some shard or the results could not be written. */
+int ps_shard_run(ps_manifest_t *m, int part, int num_parts, FILE *out,
+		 int num_threads, long *count, long *solutions) {
+  shard_run_t run;
+  pthread_t *threads;
+  int *parts, i;
+  long j;
+
+  parts = (int *)malloc((m->num_items+1)*sizeof(int));
+  ps_manifest_assign(m, num_parts, parts);
+  run.m = m;
+  run.st_data = ps_manifest_static(m);
+  run.list = (long *)malloc((m->num_shards+1)*sizeof(long));
+  for (j=0, run.num=0; j<m->num_items; j++)
+    if (parts[j] == part) run.list[run.num++] = j;
+  run.next = 0;
+  run.out = out;
+  pthread_mutex_init(&run.lock, NULL);
+  run.count = run.solutions = 0;
+  run.ok = 1;
+
+  fprintf(out, "%s %d\n%ld %d %d\n", RESULTS_MAGIC, RESULTS_VERSION,
+	  m->num_items, part, num_parts);
+  if (num_threads <= 1) shard_worker(&run);
+  else {
+    threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    for (i=0; i<num_threads; i++)
+      pthread_create(threads+i, NULL, shard_worker, &run);
+    for (i=0; i<num_threads; i++)
+      pthread_join(threads[i], NULL);
+    free(threads);
+  }
+  if (fflush(out) != 0) run.ok = 0;
+
+  *count = run.count;
+  *solutions = run.solutions;
+  pthread_mutex_destroy(&run.lock);
+  ps_static_clear(run.st_data);
+  free(run.list);
+  free(parts);
+  return(run.ok);
+}
+
+/* Where the results of a shard are. */
+typedef struct shard_result {
+  long count, num, offset;
+  int escape, file;
+} shard_result_t;
+
+/* Combine the results files for all parts of the manifest, writing the
+   solutions to out in the order in which next_pol would find them, and
+   setting count and solutions as for a single search of the whole tree.
+   Return 1 on success, 0 if a file cannot be read or does not belong to
+   the manifest, or a shard is missing or present twice. */
+int ps_shard_merge(ps_manifest_t *m, const char **filenames, int num_files,
+		   FILE *out, long *count, long *solutions) {
+  FILE **files;
+  shard_result_t *res, *r;
+  ps_manifest_item_t *item, *skip = NULL;
+  char magic[64], *line = NULL;
+  size_t size = 0;
+  long j, k, index, num_items;
+  int i, version, part, num_parts, escape, ok = 1;
+
+  files = (FILE **)calloc(num_files, sizeof(FILE *));
+  res = (shard_result_t *)malloc((m->num_items+1)*sizeof(shard_result_t));
+  for (j=0; j<m->num_items; j++) res[j].file = -1;
+
+  /* Index the results. */
+  for (i=0; ok && i<num_files; i++) {
+    files[i] = fopen(filenames[i], "r");
+    if (files[i] == NULL ||
+	fgets(magic, sizeof(magic), files[i]) == NULL ||
+	strncmp(magic, RESULTS_MAGIC, strlen(RESULTS_MAGIC)) != 0 ||
+	sscanf(magic + strlen(RESULTS_MAGIC), "%d", &version) != 1 ||
+	version != RESULTS_VERSION ||
+	fscanf(files[i], "%ld %d %d", &num_items, &part, &num_parts) != 3 ||
+	num_items != m->num_items) {
+      ok = 0;
+      break;
+    }
+    while (fscanf(files[i], " item %ld", &index) == 1) {
+      if (index < 0 || index >= m->num_items ||
+	  m->items[index].state == NULL || res[index].file >= 0) {
+	ok = 0;
+	break;
+      }
+      r = res+index;
+      if (fscanf(files[i], "%ld %d %ld", &r->count, &r->escape,
+		 &r->num) != 3 || getline(&line, &size, files[i]) < 0) {
+	ok = 0;
+	break;
+      }
+      r->file = i;
+      r->offset = ftell(files[i]);
+      for (k=0; k<r->num; k++)
+	if (getline(&line, &size, files[i]) < 0) ok = 0;
+    }
+    if (ok && !feof(files[i])) ok = 0;
+  }
+  for (j=0; ok && j<m->num_items; j++)
+    if (m->items[j].state != NULL && res[j].file < 0) ok = 0;
+
+  /* Replay the frontier, skipping what next_pol would skip after an
+     abort: the rest of the subtree of the node at the escape level. */
+  *count = *solutions = 0;
+  for (j=0; ok && j<m->num_items; j++) {
+    item = m->items+j;
+    if (skip != NULL && item->n < skip->escape) {
+      for (k=skip->escape; k<=m->d; k++)
+	if (item->path[k-item->n] != skip->path[k-skip->n]) break;
+      if (k > m->d) continue;
+    }
+    skip = NULL;
+    if (item->state == NULL) {
+      *count += 1;
+      escape = item->escape;
+    } else {
+      r = res+j;
+      *count += r->count;
+      *solutions += r->num;
+      escape = r->escape;
+      fseek(files[r->file], r->offset, SEEK_SET);
+      for (k=0; k<r->num; k++) {
+	if (getline(&line, &size, files[r->file]) < 0) ok = 0;
+	else fputs(line, out);
+      }
+    }
+    if (escape >= 0) {
+      /* The skipped entries are compared with this one from level
+	 escape on; record the escape level with the entry. */
+      item->escape = escape;
+      skip = item;
+    }
+  }
+  if (fflush(out) != 0) ok = 0;
+
+  for (i=0; i<num_files; i++)
+    if (files[i] != NULL) fclose(files[i]);
+  free(files);
+  free(res);
+  free(line);
+  return(ok);
+}
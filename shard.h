@@ -0,0 +1,44 @@
+#ifndef SHARD
+#define SHARD
+
+#include <stdio.h>
+#include "power_sums.h"
+
+/* An entry of a manifest. The entries are in the order in which next_pol
+   visits the tree: a shard, i.e., the children of a node at level
+   level+1, or a node above that level which failed. */
+typedef struct ps_manifest_item {
+  int n;                    /* the level of the node */
+  int escape;               /* see ps_frontier */
+  slong *path;              /* pol[n], ..., pol[d] */
+  ps_dynamic_data_t *state; /* the shard, or NULL for a failed node */
+  double estimate;          /* estimated count of the shard */
+} ps_manifest_item_t;
+
+/* Contents of a manifest file: the parameters of ps_static_init (as in
+   ps_checkpoint_t), the settings changing the node count, and the
+   frontier of the tree at level level. */
+typedef struct ps_manifest {
+  int d, lead, sign, q, cofactor, verbosity;
+  long node_count;
+  int *modlist;
+  int *point_count, *newton;
+  int sturm_bisect, hankel, filter;
+  int level;
+  long num_items, num_shards;
+  ps_manifest_item_t *items;
+  long *order; /* the shards, by decreasing estimate */
+} ps_manifest_t;
+
+long ps_manifest_write(const char *filename, ps_static_data_t *st_data,
+		       ps_dynamic_data_t *dy_data, int depth, long probes);
+ps_manifest_t *ps_manifest_read(const char *filename);
+ps_static_data_t *ps_manifest_static(ps_manifest_t *m);
+void ps_manifest_assign(ps_manifest_t *m, int num_parts, int *part);
+void ps_manifest_clear(ps_manifest_t *m);
+int ps_shard_run(ps_manifest_t *m, int part, int num_parts, FILE *out,
+		 int num_threads, long *count, long *solutions);
+int ps_shard_merge(ps_manifest_t *m, const char **filenames, int num_files,
+		   FILE *out, long *count, long *solutions);
+
+#endif
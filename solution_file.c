@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "solution_file.h"
+
+/* Solution files are binary, starting with a text header:
+
+     root-unitary solutions 1
+   the static data as written by ps_static_fprint, and
+     end
+   followed by any number of chunks. Each chunk consists of the number of
+   solutions and the length in bytes of the payload, both as 32-bit
+   little-endian integers, and the payload.
+
+   Each solution is stored as its coefficients pol[d], ..., pol[0] (see
+   ps_dynamic_init), relative to the previous solution in the chunk (or
+   to zero, for the first one): first the number of leading coefficients
+   which are unchanged, then the differences for the other ones. All of
+   these are varints (7 bits per byte, low bits first), the differences
+   being zigzag encoded. Since solutions in a chunk come from a single
+   worker, consecutive ones tend to share long prefixes.
+
+   The symmetrized form is recovered on reading with ps_symmetrize.
+*/
+
+#define SOLUTION_MAGIC "root-unitary solutions"
+#define SOLUTION_VERSION 1
+
+static void put_varint(ps_sink_buffer_t *b, ulong x) {
+  do {
+    b->buf[b->len++] = (x & 127) | (x > 127 ? 128 : 0);
+    x >>= 7;
+  } while (x);
+}
+
+/* Return 0 if the varint runs past end. */
+static int get_varint(const unsigned char **p, const unsigned char *end,
+		      ulong *x) {
+  int s = 0;
+  *x = 0;
+  do {
+    if (*p >= end || s >= 64) return(0);
+    *x |= (ulong)(**p & 127) << s;
+    s += 7;
+  } while (*(*p)++ & 128);
+  return(1);
+}
+
+static void put_u32(unsigned char *p, ulong x) {
+  int i;
+  for (i=0; i<4; i++) p[i] = (x >> (8*i)) & 255;
+}
+
+static ulong get_u32(const unsigned char *p) {
+  return(p[0] | (ulong)p[1] << 8 | (ulong)p[2] << 16 | (ulong)p[3] << 24);
+}
+
+/* Open a solution file for writing. If offset < 0, create it and write
+   the header; otherwise truncate it to offset and append to it (after
+   resuming from a checkpoint). Return NULL on failure. */
+ps_sink_t *ps_sink_open(const char *filename, ps_static_data_t *st_data,
+			long offset) {
+  ps_sink_t *sink;
+  FILE *f;
+
+  if (offset < 0) {
+    f = fopen(filename, "wb");
+    if (f == NULL) return(NULL);
+    fprintf(f, "%s %d\n", SOLUTION_MAGIC, SOLUTION_VERSION);
+    ps_static_fprint(f, st_data);
+    fprintf(f, "end\n");
+  } else {
+    f = fopen(filename, "r+b");
+    if (f == NULL) return(NULL);
+    if (ftruncate(fileno(f), offset) != 0 || fseek(f, offset, SEEK_SET)) {
+      fclose(f);
+      return(NULL);
+    }
+  }
+  sink = (ps_sink_t *)malloc(sizeof(ps_sink_t));
+  sink->f = f;
+  pthread_mutex_init(&sink->lock, NULL);
+  sink->d = st_data->d;
+  sink->solutions = 0;
+  sink->error = 0;
+  return(sink);
+}
+
+/* Return the current length of the file. Only chunks flushed so far are
+   included; pause the writers and flush their buffers first. Return -1
+   if some chunk could not be written (see ps_sink_error). */
+long ps_sink_tell(ps_sink_t *sink) {
+  long r;
+  pthread_mutex_lock(&sink->lock);
+  if (fflush(sink->f) != 0) sink->error = 1;
+  r = sink->error ? -1 : ftell(sink->f);
+  pthread_mutex_unlock(&sink->lock);
+  return(r);
+}
+
+long ps_sink_count(ps_sink_t *sink) {
+  long r;
+  pthread_mutex_lock(&sink->lock);
+  r = sink->solutions;
+  pthread_mutex_unlock(&sink->lock);
+  return(r);
+}
+
+/* Return 1 if some chunk could not be written so far. The solutions in
+   it are lost, so the file is incomplete. */
+int ps_sink_error(ps_sink_t *sink) {
+  int r;
+  pthread_mutex_lock(&sink->lock);
+  r = sink->error;
+  pthread_mutex_unlock(&sink->lock);
+  return(r);
+}
+
+/* Return 1 on success, 0 on failure, including that of an earlier
+   flush. */
+int ps_sink_close(ps_sink_t *sink) {
+  int r = (fclose(sink->f) == 0) && !sink->error;
+  pthread_mutex_destroy(&sink->lock);
+  free(sink);
+  return(r);
+}
+
+void ps_sink_buffer_init(ps_sink_buffer_t *b, ps_sink_t *sink) {
+  b->sink = sink;
+  /* A solution takes at most 10*(d+2) bytes. */
+  b->size = PS_SINK_CHUNK + 10*(sink->d+2);
+  b->buf = (unsigned char *)malloc(b->size);
+  b->len = 8;
+  b->num = 0;
+  b->prev = (slong *)calloc(sink->d+1, sizeof(slong));
+}
+
+/* Write the chunk in the buffer, if any, and start a new one.
+   Return 1 on success, 0 on failure; a failure is also recorded in the
+   sink, for ps_sink_close, as the writers need not check. */
+int ps_sink_flush(ps_sink_buffer_t *b) {
+  ps_sink_t *sink = b->sink;
+  int r = 1;
+
+  if (b->num == 0) return(1);
+  put_u32(b->buf, b->num);
+  put_u32(b->buf+4, b->len-8);
+  pthread_mutex_lock(&sink->lock);
+  r = (fwrite(b->buf, 1, b->len, sink->f) == b->len);
+  if (r) sink->solutions += b->num;
+  else sink->error = 1;
+  pthread_mutex_unlock(&sink->lock);
+  b->len = 8;
+  b->num = 0;
+  memset(b->prev, 0, (sink->d+1)*sizeof(slong));
+  return(r);
+}
+
+/* Append the current solution of dy_data. Return 0 if this flushed the
+   buffer and the chunk could not be written, and otherwise 1. */
+int ps_sink_add(ps_sink_buffer_t *b, ps_dynamic_data_t *dy_data) {
+  int i, k, d = b->sink->d;
+  slong c, delta;
+
+  for (k=0; k<=d; k++)
+    if (fmpz_get_si(dy_data->pol+d-k) != b->prev[k]) break;
+  put_varint(b, k);
+  for (i=k; i<=d; i++) {
+    c = fmpz_get_si(dy_data->pol+d-i);
+    delta = c - b->prev[i];
+    put_varint(b, delta < 0 ? ~((ulong)delta << 1) : (ulong)delta << 1);
+    b->prev[i] = c;
+  }
+  b->num += 1;
+  if (b->len >= PS_SINK_CHUNK) return(ps_sink_flush(b));
+  return(1);
+}
+
+void ps_sink_buffer_clear(ps_sink_buffer_t *b) {
+  free(b->buf);
+  free(b->prev);
+}
+
+/* Open a solution file for reading. Return NULL if it cannot be read. */
+ps_solfile_t *ps_solfile_open(const char *filename) {
+  ps_solfile_t *sf;
+  char line[64];
+  int i, version, verbosity;
+  long node_count;
+  FILE *f;
+
+  f = fopen(filename, "rb");
+  if (f == NULL) return(NULL);
+  sf = (ps_solfile_t *)malloc(sizeof(ps_solfile_t));
+  sf->modlist = NULL;
+  sf->data = MAP_FAILED;
+
+  /* Parse the header, which ends with the line "end". */
+  if (fgets(line, sizeof(line), f) == NULL ||
+      strncmp(line, SOLUTION_MAGIC, strlen(SOLUTION_MAGIC)) != 0 ||
+      sscanf(line + strlen(SOLUTION_MAGIC), "%d", &version) != 1 ||
+      version != SOLUTION_VERSION ||
+      fscanf(f, "%d %d %d %d %d %d %ld", &sf->d, &sf->lead, &sf->sign,
+	     &sf->q, &sf->cofactor, &verbosity, &node_count) != 7 ||
+      sf->d < 0)
+    goto fail;
+  sf->modlist = (int *)malloc((sf->d+1)*sizeof(int));
+  for (i=0; i<=sf->d; i++)
+    if (fscanf(f, "%d", sf->modlist+i) != 1) goto fail;
+  do
+    if (fgets(line, sizeof(line), f) == NULL) goto fail;
+  while (strcmp(line, "end\n") != 0);
+  sf->pos = ftell(f);
+  fseek(f, 0, SEEK_END);
+  sf->size = ftell(f);
+  if (sf->size > sf->pos) {
+    sf->data = (unsigned char *)mmap(NULL, sf->size, PROT_READ, MAP_PRIVATE,
+				     fileno(f), 0);
+    if (sf->data == MAP_FAILED) goto fail;
+  }
+  fclose(f);
+
+  sf->left = 0;
+  sf->pol = (slong *)calloc(sf->d+1, sizeof(slong));
+  sf->fpol = _fmpz_vec_init(sf->d+1);
+  sf->sympol = _fmpz_vec_init(2*sf->d+3);
+  sf->cof = _fmpz_vec_init(3);
+  fmpz_init(sf->temp);
+  ps_cofactor(sf->cof, sf->cofactor, sf->q);
+  return(sf);
+
+ fail:
+  fclose(f);
+  free(sf->modlist);
+  free(sf);
+  return(NULL);
+}
+
+/* Read the next solution into Q, in symmetrized form (2*d+3 entries);
+   the asymmetric form is left in sf->pol. Return values:
+    1: if a solution has been read
+    0: at the end of the file
+   -1: if the file is truncated or corrupt
+*/
+int ps_solfile_next(ps_solfile_t *sf, int *Q) {
+  const unsigned char *p, *end;
+  int i, d = sf->d;
+  ulong k, x;
+
+  while (sf->left == 0) {
+    if (sf->pos == sf->size) return(0);
+    if (sf->pos + 8 > sf->size) return(-1);
+    sf->left = get_u32(sf->data + sf->pos);
+    x = get_u32(sf->data + sf->pos + 4);
+    if (sf->pos + 8 + x > sf->size) return(-1);
+    sf->pos += 8;
+    sf->chunk_end = sf->pos + x;
+    memset(sf->pol, 0, (d+1)*sizeof(slong));
+  }
+
+  p = sf->data + sf->pos;
+  end = sf->data + sf->chunk_end;
+  if (!get_varint(&p, end, &k) || k > (ulong)d + 1) return(-1);
+  for (i=k; i<=d; i++) {
+    if (!get_varint(&p, end, &x)) return(-1);
+    sf->pol[d-i] += (slong)(x >> 1) ^ -(slong)(x & 1);
+  }
+  sf->pos = p - sf->data;
+  sf->left -= 1;
+  if (sf->left == 0 && sf->pos != sf->chunk_end) return(-1);
+
+  for (i=0; i<=d; i++)
+    fmpz_set_si(sf->fpol+i, sf->pol[i]);
+  ps_symmetrize(sf->sympol, sf->fpol, d, sf->q, sf->sign, sf->cof, sf->temp);
+  for (i=0; i<=2*d+2; i++)
+    Q[i] = fmpz_get_si(sf->sympol+i);
+  return(1);
+}
+
+void ps_solfile_close(ps_solfile_t *sf) {
+  if (sf->data != MAP_FAILED) munmap(sf->data, sf->size);
+  free(sf->modlist);
+  free(sf->pol);
+  _fmpz_vec_clear(sf->fpol, sf->d+1);
+  _fmpz_vec_clear(sf->sympol, 2*sf->d+3);
+  _fmpz_vec_clear(sf->cof, 3);
+  fmpz_clear(sf->temp);
+  free(sf);
+}
+
+/* Write the solutions in a solution file to out, in the text format of
+   process_queue.parallel_exhaust (one list per line). Return the number
+   of solutions, or -1 if the file cannot be read or is corrupt. */
+long ps_solfile_to_text(const char *filename, FILE *out) {
+  ps_solfile_t *sf;
+  long n = 0;
+  int i, t, *Q;
+
+  sf = ps_solfile_open(filename);
+  if (sf == NULL) return(-1);
+  Q = (int *)malloc((2*sf->d+3)*sizeof(int));
+  while ((t = ps_solfile_next(sf, Q)) > 0) {
+    fprintf(out, "[");
+    for (i=0; i<=2*sf->d+2; i++)
+      fprintf(out, i ? ", %d" : "%d", Q[i]);
+    fprintf(out, "]\n");
+    n++;
+  }
+  free(Q);
+  ps_solfile_close(sf);
+  return(t < 0 ? -1 : n);
+}
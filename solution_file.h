@@ -0,0 +1,59 @@
+#ifndef SOLUTION_FILE
+#define SOLUTION_FILE
+
+#include <stdio.h>
+#include <pthread.h>
+#include "power_sums.h"
+
+/* Solutions are written in chunks of about this many bytes. */
+#define PS_SINK_CHUNK 65536
+
+/* An open binary solution file, shared by the writers. */
+typedef struct ps_sink {
+  FILE *f;
+  pthread_mutex_t lock; /* protects f, solutions and error */
+  int d;
+  long solutions; /* number of solutions written */
+  int error;      /* set once a chunk could not be written */
+} ps_sink_t;
+
+/* A buffer holding the chunk being built by one writer. */
+typedef struct ps_sink_buffer {
+  ps_sink_t *sink;
+  unsigned char *buf;
+  size_t len, size;
+  int num;
+  slong *prev; /* the previous solution in the chunk, pol[d] first */
+} ps_sink_buffer_t;
+
+/* A solution file being read, memory-mapped. */
+typedef struct ps_solfile {
+  int d, lead, sign, q, cofactor;
+  int *modlist;
+  unsigned char *data;
+  size_t size, pos; /* pos is the position of the next solution */
+  size_t chunk_end;
+  int left;         /* number of solutions left in the current chunk */
+  slong *pol;       /* the last solution read, as pol[0], ..., pol[d] */
+  fmpz *fpol, *sympol, *cof;
+  fmpz_t temp;
+} ps_solfile_t;
+
+ps_sink_t *ps_sink_open(const char *filename, ps_static_data_t *st_data,
+			long offset);
+long ps_sink_tell(ps_sink_t *sink);
+long ps_sink_count(ps_sink_t *sink);
+int ps_sink_error(ps_sink_t *sink);
+int ps_sink_close(ps_sink_t *sink);
+
+void ps_sink_buffer_init(ps_sink_buffer_t *b, ps_sink_t *sink);
+int ps_sink_add(ps_sink_buffer_t *b, ps_dynamic_data_t *dy_data);
+int ps_sink_flush(ps_sink_buffer_t *b);
+void ps_sink_buffer_clear(ps_sink_buffer_t *b);
+
+ps_solfile_t *ps_solfile_open(const char *filename);
+int ps_solfile_next(ps_solfile_t *sf, int *Q);
+void ps_solfile_close(ps_solfile_t *sf);
+long ps_solfile_to_text(const char *filename, FILE *out);
+
+#endif
@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "power_sums.h"
+#include "work_stealing.h"
+#include "checkpoint.h"
+#include "solution_file.h"
+#include "shard.h"
+#include "remote.h"
+
+/* Command-line front end to the search, linked against libpowersums.
+
+   The arguments are those of process_queue (see prescribed_roots.sage,
+   which computes them from the polynomial being searched for): Q0 is
+   given by its coefficients, constant term first, after "--" (as they
+   may be negative). The solutions are written one per line as lists of
+   2*d+3 coefficients, as in process_queue.parallel_exhaust, or in the
+   binary format of solution_file.c. The number of solutions and the node
+   count are printed on stderr at the end.
+
+   With -e, nothing is searched; instead, estimates of the number of
+   solutions and of the node count are printed (see ps_estimate), with
+   95% confidence intervals.
+
+   With -j, the search is split into shards to be run separately, e.g.,
+   on several machines (see shard.c): with -D, the manifest is written
+   (using -e probes per shard for the estimates); with -u i/N, part i
+   (counting from 0) out of N is searched, writing a results file to the
+   output; with -g, the results files given as arguments are merged into
+   the solutions of the whole search.
+
+   With -C, the search is run by the worker processes connecting to the
+   given address (see remote.c), each started as weilsearch -W address;
+   the solutions are written in no particular order.
+
+   With -p, nothing is searched either; instead, that many random
+   solutions are drawn (see ps_sample), each preceded on its line by its
+   weight, the inverse of the probability of drawing it. With -U, they
+   are drawn uniformly instead, given a bound on the weights (0 for twice
+   the largest weight of as many samples drawn beforehand).
+
+   With -x, the solutions are only counted (see ps_static_set_count_only);
+   as for -B and -H, this must be given again when resuming.
+
+   With -O 1, the values of each coefficient are tried from the middle of
+   their range up, then below (see ps_static_set_order), which tends to
+   find the first solutions sooner, e.g., with -a; the solutions are the
+   same, but come in a different order, and the node count can differ.
+*/
+
+static void usage() {
+  fprintf(stderr,
+	  "usage: weilsearch [options] -- c_0 c_1 ... c_d\n"
+	  "       weilsearch -r -k checkpoint [options]\n"
+	  "       weilsearch -D depth -j manifest [options] -- c_0 c_1 ... c_d\n"
+	  "       weilsearch -j manifest -u i/N [-t threads] [-o file]\n"
+	  "       weilsearch -j manifest -g [-o file] results ...\n"
+	  "       weilsearch -W address\n"
+	  "  -l lead       leading coefficient (default 1)\n"
+	  "  -s sign       sign (default 1)\n"
+	  "  -q q          q (default 1)\n"
+	  "  -c cofactor   cofactor index, 0 to 3 (default 0)\n"
+	  "  -m modulus    modulus for the coefficients (default 1)\n"
+	  "  -n n          number of fixed leading coefficients (default 0)\n"
+	  "  -M m_0,...,m_d  moduli of c_0, ..., c_d, overriding -m and -n\n"
+	  "  -N count      node limit (default none)\n"
+	  "  -a count      stop after this many solutions (default all)\n"
+	  "  -F flags      leaf filters (1: no roots of unity, 2: EJ test)\n"
+	  "  -B flag       Sturm bisection (see ps_static_set_sturm_bisect)\n"
+	  "  -H flag       Hankel test (see ps_static_set_hankel)\n"
+	  "  -x            only count the solutions\n"
+	  "  -O order      0: in increasing order, 1: from the middle (default 0)\n"
+	  "  -t threads    number of threads (default 1)\n"
+	  "  -o file       output file (default stdout)\n"
+	  "  -b            write the binary format (requires -o)\n"
+	  "  -k file       checkpoint file\n"
+	  "  -i seconds    checkpoint interval (default 60)\n"
+	  "  -r            resume from the checkpoint file\n"
+	  "  -e probes     only estimate the size of the tree\n"
+	  "  -S seed       random seed for -e and -p (default 0)\n"
+	  "  -w            weighted probes for -e and -p\n"
+	  "  -p samples    only draw this many random solutions\n"
+	  "  -U bound      draw them uniformly, given this bound on the weights\n"
+	  "  -z            direct probes for -p (see ps_sample)\n"
+	  "  -j file       manifest file\n"
+	  "  -D depth      write the manifest, with shards depth levels down\n"
+	  "  -u i/N        search part i of N of the manifest\n"
+	  "  -g            merge results files of the manifest\n"
+	  "  -C address    coordinate workers at address (host:port or a path)\n"
+	  "  -W address    work for the coordinator at address\n");
+  exit(2);
+}
+
+/* Open the output file, truncating it to offset if offset >= 0. */
+static FILE *open_output(const char *filename, long offset) {
+  FILE *f;
+  if (filename == NULL) return(stdout);
+  if (offset < 0) return(fopen(filename, "w"));
+  f = fopen(filename, "r+");
+  if (f == NULL) return(NULL);
+  if (ftruncate(fileno(f), offset) != 0 || fseek(f, offset, SEEK_SET)) {
+    fclose(f);
+    return(NULL);
+  }
+  return(f);
+}
+
+static void print_pol(FILE *f, int *Q, int len) {
+  int i;
+  fprintf(f, "[");
+  for (i=0; i<len; i++)
+    fprintf(f, i ? ", %d" : "%d", Q[i]);
+  fprintf(f, "]\n");
+}
+
+/* Search part i/N of the manifest, or merge the results files. */
+static int shard_main(const char *manname, const char *partstr, int merge,
+		      int threads, const char *outname, int num_files,
+		      const char **filenames) {
+  ps_manifest_t *m;
+  int part = 0, num_parts = 0, t;
+  long count, solutions;
+  FILE *out;
+
+  if (merge ? (partstr != NULL || num_files == 0)
+      : (partstr == NULL || num_files != 0 ||
+	 sscanf(partstr, "%d/%d", &part, &num_parts) != 2 ||
+	 part < 0 || part >= num_parts))
+    usage();
+  m = ps_manifest_read(manname);
+  if (m == NULL) {
+    fprintf(stderr, "weilsearch: cannot read manifest file %s\n", manname);
+    return(1);
+  }
+  out = open_output(outname, -1);
+  if (out == NULL) {
+    fprintf(stderr, "weilsearch: cannot open output file %s\n", outname);
+    return(1);
+  }
+  if (merge) {
+    t = ps_shard_merge(m, filenames, num_files, out, &count, &solutions);
+    if (!t)
+      fprintf(stderr, "weilsearch: results files do not match manifest %s\n",
+	      manname);
+  } else {
+    t = ps_shard_run(m, part, num_parts, out, threads, &count, &solutions);
+    if (!t)
+      fprintf(stderr, "weilsearch: node count (%ld) exceeded or cannot write "
+	      "output\n", m->node_count);
+  }
+  if (out != stdout && fclose(out) != 0) t = 0;
+  if (t) fprintf(stderr, "solutions %ld count %ld\n", solutions, count);
+  ps_manifest_clear(m);
+  return(!t);
+}
+
+static void print_estimate(const char *name, double x, double err) {
+  printf("%s %.0f (95%% interval %.0f to %.0f)\n", name, x,
+	 (x - 1.96*err > 0) ? x - 1.96*err : 0, x + 1.96*err);
+}
+
+/* A sample is given up after this many probes (see ps_sample). */
+#define MAX_PROBES 1000000
+
+/* Draw random solutions, with their weights, to outname. */
+static int sample_main(ps_static_data_t *st_data, ps_dynamic_data_t **states,
+		       long samples, ulong seed, int flags, double bound,
+		       int threads, const char *outname) {
+  int d = st_data->d, len = 2*d+3, t = 0;
+  ps_sample_stats_t res;
+  double *weights, mean, err = 0.0;
+  int *Q;
+  long i, num;
+  FILE *out;
+
+  out = open_output(outname, -1);
+  if (out == NULL) {
+    fprintf(stderr, "weilsearch: cannot open output file %s\n", outname);
+    return(1);
+  }
+  Q = (int *)malloc(samples*len*sizeof(int));
+  weights = (double *)malloc(samples*sizeof(double));
+  if (bound == 0.0) {
+    ps_sample(st_data, states[0], samples, ~seed, flags, 0.0, MAX_PROBES,
+	      threads, Q, weights, &res);
+    bound = 2*res.max_weight;
+  }
+  if (bound > 0.0) flags |= PS_SAMPLE_UNIFORM;
+  else if (bound == 0.0) {
+    fprintf(stderr, "weilsearch: no solutions found to bound the weights\n");
+    t = 1;
+  }
+  if (!t) {
+    num = ps_sample(st_data, states[0], samples, seed, flags, bound,
+		    MAX_PROBES, threads, Q, weights, &res);
+    for (i=0; i<num; i++) {
+      fprintf(out, "%.17g ", weights[i]);
+      print_pol(out, Q + i*len, len);
+    }
+    /* The estimate of the number of solutions, as for -e. */
+    mean = res.weight/res.probes;
+    if (res.probes > 1)
+      err = sqrt(fmax(res.weight2/res.probes - mean*mean, 0.0)/(res.probes-1));
+    fprintf(stderr, "samples %ld probes %ld cost %ld solutions %.0f "
+	    "(95%% interval %.0f to %.0f)\n", num, res.probes, res.cost, mean,
+	    (mean - 1.96*err > 0) ? mean - 1.96*err : 0, mean + 1.96*err);
+    if (flags & PS_SAMPLE_UNIFORM)
+      fprintf(stderr, "bound %.17g excess %ld\n", bound, res.excess);
+  }
+  if (out != stdout && fclose(out) != 0) {
+    fprintf(stderr, "weilsearch: cannot write output file %s\n", outname);
+    t = 1;
+  }
+  free(Q);
+  free(weights);
+  ps_dynamic_clear(states[0]);
+  free(states);
+  ps_static_clear(st_data);
+  return(t);
+}
+
+int main(int argc, char **argv) {
+  int d, i, t, opt;
+  int lead = 1, sign = 1, q = 1, cofactor = 0, modulus = 1, n = 0;
+  int filter = 0, bisect = -1, hankel = -1, threads = 1;
+  int binary = 0, resume = 0, reached, weighted = 0, depth = 0, merge = 0;
+  int count_only = 0, direct = 0, order = 0;
+  long node_count = -1, answer_count = -1;
+  long count = 0, solutions = 0, offset = -1, probes = 0, samples = 0;
+  long remote_count, remote_solutions;
+  ulong seed = 0;
+  double interval = 60.0, bound = -1.0;
+  char *modstr = NULL, *outname = NULL, *ckname = NULL, *s;
+  char *manname = NULL, *partstr = NULL, *coordinator = NULL;
+  char *worker = NULL;
+  int *Q0, *modlist, *Q;
+  ps_static_data_t *st_data;
+  ps_dynamic_data_t **states;
+  int num_states;
+  ps_checkpoint_t *ck = NULL;
+  ps_pool_t *pool;
+  ps_sink_t *sink = NULL;
+  ps_estimate_t est;
+  FILE *out = NULL;
+  time_t last;
+
+  while ((opt = getopt(argc, argv, "l:s:q:c:m:n:M:N:a:F:B:H:xO:t:o:bk:i:r"
+			"e:S:wp:U:zj:D:u:gC:W:")) != -1) {
+    switch (opt) {
+    case 'l': lead = atoi(optarg); break;
+    case 's': sign = atoi(optarg); break;
+    case 'q': q = atoi(optarg); break;
+    case 'c': cofactor = atoi(optarg); break;
+    case 'm': modulus = atoi(optarg); break;
+    case 'n': n = atoi(optarg); break;
+    case 'M': modstr = optarg; break;
+    case 'N': node_count = atol(optarg); break;
+    case 'a': answer_count = atol(optarg); break;
+    case 'F': filter = atoi(optarg); break;
+    case 'B': bisect = atoi(optarg); break;
+    case 'H': hankel = atoi(optarg); break;
+    case 'x': count_only = 1; break;
+    case 'O': order = atoi(optarg); break;
+    case 't': threads = atoi(optarg); break;
+    case 'o': outname = optarg; break;
+    case 'b': binary = 1; break;
+    case 'k': ckname = optarg; break;
+    case 'i': interval = atof(optarg); break;
+    case 'r': resume = 1; break;
+    case 'e': probes = atol(optarg); break;
+    case 'S': seed = strtoul(optarg, NULL, 10); break;
+    case 'w': weighted = 1; break;
+    case 'p': samples = atol(optarg); break;
+    case 'U': bound = atof(optarg); break;
+    case 'z': direct = 1; break;
+    case 'j': manname = optarg; break;
+    case 'D': depth = atoi(optarg); break;
+    case 'u': partstr = optarg; break;
+    case 'g': merge = 1; break;
+    case 'C': coordinator = optarg; break;
+    case 'W': worker = optarg; break;
+    default: usage();
+    }
+  }
+  if (worker != NULL) {
+    if (optind != argc) usage();
+    if (!ps_remote_worker_run(worker)) {
+      fprintf(stderr, "weilsearch: cannot reach or lost the coordinator "
+	      "at %s\n", worker);
+      return(1);
+    }
+    return(0);
+  }
+  if (threads < 1 || (binary && outname == NULL) || (resume && ckname == NULL)
+      || cofactor < 0 || cofactor > 3 || probes < 0 || (probes && resume)
+      || samples < 0 || (samples && (resume || probes || binary))
+      || ((bound >= 0.0 || direct) && !samples)
+      || order < 0 || order > 1
+      || (order && (manname != NULL || coordinator != NULL))
+      || (count_only && (binary || answer_count != -1 || manname != NULL ||
+			 coordinator != NULL)))
+    usage();
+  if (manname != NULL && depth == 0)
+    return(shard_main(manname, partstr, merge, threads, outname,
+		      argc - optind, (const char **)(argv + optind)));
+  if ((depth != 0 && (manname == NULL || resume)) || partstr != NULL || merge)
+    usage();
+  if (coordinator != NULL && ((ckname != NULL && !resume) || binary ||
+			      answer_count != -1 || probes || depth))
+    usage();
+
+  if (resume) {
+    if (optind != argc) usage();
+    ck = ps_checkpoint_read(ckname);
+    if (ck == NULL) {
+      fprintf(stderr, "weilsearch: cannot read checkpoint file %s\n", ckname);
+      return(1);
+    }
+    /* All the solutions asked for are already in the output: stop here,
+       as the pool cannot be limited to no further solutions. */
+    if (answer_count != -1 && ck->solutions >= answer_count) {
+      fprintf(stderr, "solutions %ld count %ld\n", ck->solutions, ck->count);
+      ps_checkpoint_clear(ck);
+      return(0);
+    }
+    d = ck->d;
+    st_data = ps_static_init(d, ck->lead, ck->sign, ck->q, ck->cofactor,
+			     ck->modlist, ck->verbosity, ck->node_count,
+			     ck->point_count, ck->newton);
+    states = ck->states;
+    num_states = ck->num_states;
+    count = ck->count;
+    solutions = ck->solutions;
+    offset = ck->offset;
+  } else {
+    d = argc - optind - 1;
+    if (d < 0) usage();
+    Q0 = (int *)malloc((d+1)*sizeof(int));
+    modlist = (int *)malloc((d+1)*sizeof(int));
+    for (i=0; i<=d; i++) {
+      Q0[i] = strtol(argv[optind+i], &s, 10);
+      if (*s != '\0') usage();
+    }
+    if (modstr != NULL) {
+      for (i=0, s=modstr; i<=d; i++, s++) {
+	modlist[i] = strtol(s, &s, 10);
+	if (*s != (i < d ? ',' : '\0')) usage();
+      }
+    } else {
+      /* As in prescribed_roots.sage: the last n coefficients are fixed. */
+      for (i=0; i<=d; i++)
+	modlist[i] = (d-i < n) ? 0 : modulus;
+    }
+    st_data = ps_static_init(d, lead, sign, q, cofactor, modlist,
+			     -1, node_count, NULL, NULL);
+    states = (ps_dynamic_data_t **)malloc(sizeof(ps_dynamic_data_t *));
+    states[0] = ps_dynamic_init(d, Q0);
+    num_states = 1;
+    free(Q0);
+    free(modlist);
+  }
+  if (bisect >= 0) ps_static_set_sturm_bisect(st_data, bisect);
+  if (hankel >= 0) ps_static_set_hankel(st_data, hankel);
+  if (filter) ps_static_set_filter(st_data, filter);
+  if (count_only) ps_static_set_count_only(st_data, 1);
+  if (order) ps_static_set_order(st_data, order);
+  for (i=0; i<num_states; i++)
+    ps_dynamic_restore(st_data, states[i]);
+
+  if (depth) {
+    if (depth < 0 || depth > d) usage();
+    count = ps_manifest_write(manname, st_data, states[0], depth, probes);
+    if (count < 0)
+      fprintf(stderr, "weilsearch: cannot write manifest file %s\n", manname);
+    else fprintf(stderr, "shards %ld\n", count);
+    ps_dynamic_clear(states[0]);
+    free(states);
+    ps_static_clear(st_data);
+    return(count < 0);
+  }
+
+  if (probes) {
+    ps_estimate(st_data, states[0], probes, seed,
+		weighted ? PS_ESTIMATE_WEIGHTED : 0, &est);
+    print_estimate("count", est.count, est.count_err);
+    print_estimate("solutions", est.solutions, est.solutions_err);
+    print_estimate("nodes", est.nodes, est.nodes_err);
+    ps_dynamic_clear(states[0]);
+    free(states);
+    ps_static_clear(st_data);
+    return(0);
+  }
+
+  if (samples)
+    return(sample_main(st_data, states, samples, seed,
+		       direct ? PS_SAMPLE_DIRECT :
+		       weighted ? PS_ESTIMATE_WEIGHTED : 0,
+		       bound, threads, outname));
+
+  if (binary) {
+    sink = ps_sink_open(outname, st_data, offset);
+    if (sink == NULL) {
+      fprintf(stderr, "weilsearch: cannot open solution file %s\n", outname);
+      return(1);
+    }
+  } else {
+    out = open_output(outname, offset);
+    if (out == NULL) {
+      fprintf(stderr, "weilsearch: cannot open output file %s\n", outname);
+      return(1);
+    }
+  }
+
+  if (coordinator != NULL) {
+    t = ps_coordinator_run(coordinator, st_data, states, num_states, out,
+			   &remote_count, &remote_solutions);
+    count += remote_count;
+    solutions += remote_solutions;
+    if (out != stdout && fclose(out) != 0) {
+      fprintf(stderr, "weilsearch: cannot write output file %s\n", outname);
+      t = 0;
+    }
+    fprintf(stderr, "solutions %ld count %ld\n", solutions, count);
+    if (!t)
+      fprintf(stderr, "weilsearch: cannot listen at %s, lost a worker, or "
+	      "node count (%ld) exceeded\n", coordinator, st_data->node_count);
+    if (ck != NULL) ps_checkpoint_clear(ck);
+    else {
+      ps_dynamic_clear(states[0]);
+      free(states);
+    }
+    ps_static_clear(st_data);
+    return(!t);
+  }
+
+  Q = (int *)malloc((2*d+3)*sizeof(int));
+  /* After a resume, only the solutions still missing are looked for. */
+  if (answer_count != -1) answer_count -= solutions;
+  pool = ps_pool_init_limit(st_data, states, num_states, threads, sink,
+			    answer_count);
+  last = time(NULL);
+  while ((t = ps_pool_next_solution(pool, Q)) != 0) {
+    if (t > 0) {
+      solutions += 1;
+      print_pol(out, Q, 2*d+3);
+    }
+    if (ckname != NULL && difftime(time(NULL), last) >= interval) {
+      ps_pool_pause(pool);
+      /* Emit whatever the workers found before parking, so that the
+	 checkpoint lies past all emitted solutions. */
+      while (ps_pool_next_solution(pool, Q) > 0) {
+	solutions += 1;
+	print_pol(out, Q, 2*d+3);
+      }
+      if (sink != NULL) {
+	offset = ps_sink_tell(sink);
+	if (offset < 0) {
+	  fprintf(stderr, "weilsearch: cannot write output file %s\n",
+		  outname);
+	  return(1);
+	}
+	t = ps_pool_checkpoint(pool, ckname, count,
+			       solutions + ps_sink_count(sink), offset);
+      } else {
+	fflush(out);
+	offset = (out == stdout) ? -1 : ftell(out);
+	t = ps_pool_checkpoint(pool, ckname, count, solutions, offset);
+      }
+      if (!t) {
+	fprintf(stderr, "weilsearch: cannot write checkpoint file %s\n",
+		ckname);
+	return(1);
+      }
+      ps_pool_resume(pool);
+      last = time(NULL);
+    }
+  }
+  count += ps_pool_count(pool);
+  solutions += ps_pool_solution_count(pool);
+  reached = ps_pool_reached(pool);
+  ps_pool_clear(pool);
+
+  t = 0;
+  if (sink != NULL) {
+    solutions += ps_sink_count(sink);
+    if (!ps_sink_close(sink)) t = 1;
+  } else if (out != stdout) {
+    if (fclose(out) != 0) t = 1;
+  } else fflush(out);
+  if (t) {
+    fprintf(stderr, "weilsearch: cannot write output file %s\n", outname);
+    return(1);
+  }
+  fprintf(stderr, "solutions %ld count %ld\n", solutions, count);
+  if (reached == PS_POOL_NODES) {
+    fprintf(stderr, "weilsearch: node count (%ld) exceeded\n",
+	    st_data->node_count);
+    t = 1;
+  }
+
+  free(Q);
+  if (ck != NULL) ps_checkpoint_clear(ck);
+  else {
+    ps_dynamic_clear(states[0]);
+    free(states);
+  }
+  ps_static_clear(st_data);
+  return(t);
+}
@@ -0,0 +1,563 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "work_stealing.h"
+#include "checkpoint.h"
+
+/* Work-stealing scheduler for next_pol.
+
+   Each worker runs next_pol on a subtree of its own. A worker that runs
+   out of work first tries to take a subtree from the head of another
+   worker's deque. If there is none, it sets the interrupt flag of a busy
+   worker; the latter then splits its current subtree with ps_dynamic_split
+   and pushes the new piece onto its deque, where it can be stolen.
+
+   Solutions are collected without any locking: workers push them onto
+   a Treiber stack, and the consumer detaches the whole stack at once.
+
+   Alternatively, solutions can be written to a binary solution file
+   (see solution_file.c); each worker then fills a chunk of its own.
+
+   A pool can also run a batch of searches sharing d (and typically q
+   and lead, so that their static data share one ps_static_table_t):
+   each state then names the static data it belongs to, and solutions
+   and counts are tagged accordingly. Many small searches thus keep all
+   of the threads busy, without starting a pool for each.
+
+   For checkpointing, the pool can be paused: every worker then stops at
+   the next point where its subtree could be split, and parks. Pending
+   chunks are written first, so that the file matches the checkpoint.
+*/
+
+/* Deque operations; these must be called with w->lock held. */
+static void deque_push(ps_worker_t *w, ps_dynamic_data_t *dy_data) {
+  if (w->tail == w->size) {
+    if (w->head > 0) {
+      memmove(w->deque, w->deque + w->head,
+	      (w->tail - w->head)*sizeof(ps_dynamic_data_t *));
+      w->tail -= w->head;
+      w->head = 0;
+    } else {
+      w->size *= 2;
+      w->deque = (ps_dynamic_data_t **)realloc(w->deque,
+				   w->size*sizeof(ps_dynamic_data_t *));
+    }
+  }
+  w->deque[w->tail] = dy_data;
+  __atomic_store_n(&w->tail, w->tail+1, __ATOMIC_RELEASE);
+}
+
+static ps_dynamic_data_t *deque_pop_tail(ps_worker_t *w) {
+  if (w->head == w->tail) return(NULL);
+  w->tail -= 1;
+  return(w->deque[w->tail]);
+}
+
+static ps_dynamic_data_t *deque_pop_head(ps_worker_t *w) {
+  if (w->head == w->tail) return(NULL);
+  w->head += 1;
+  return(w->deque[w->head-1]);
+}
+
+static int deque_is_empty(ps_worker_t *w) {
+  return(__atomic_load_n(&w->head, __ATOMIC_RELAXED) ==
+	 __atomic_load_n(&w->tail, __ATOMIC_RELAXED));
+}
+
+static void ps_pool_backoff() {
+  struct timespec ts = {0, 50000};
+  nanosleep(&ts, NULL);
+}
+
+static void ps_pool_push_solution(ps_pool_t *pool,
+				  ps_dynamic_data_t *dy_data) {
+  ps_solution_t *s;
+
+  s = (ps_solution_t *)malloc(sizeof(ps_solution_t) +
+			      (2*pool->d+3)*sizeof(int));
+  s->job = dy_data->job;
+  extract_symmetrized_pol(s->Q, dy_data);
+  s->next = __atomic_load_n(&pool->solutions, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&pool->solutions, &s->next, s, 1,
+				      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Stop all workers at their next split point, recording why. */
+static void ps_pool_cancel(ps_pool_t *pool, int reason) {
+  int i, r = 0;
+  __atomic_compare_exchange_n(&pool->reached, &r, reason, 0,
+			      __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  __atomic_store_n(&pool->stop, 1, __ATOMIC_RELAXED);
+  for (i=0; i<pool->num_threads; i++)
+    __atomic_store_n(&pool->workers[i].interrupt, 1, __ATOMIC_RELAXED);
+}
+
+/* Record that a job has used up its node budget. This stops the pool,
+   unless it runs a batch: the workers then only give up the subtrees of
+   that job, as they come to them (see ps_worker_charge). */
+static void ps_pool_cancel_nodes(ps_pool_t *pool) {
+  int r = 0;
+  if (pool->num_jobs == 1) ps_pool_cancel(pool, PS_POOL_NODES);
+  else __atomic_compare_exchange_n(&pool->reached, &r, PS_POOL_NODES, 0,
+				   __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* Add the nodes searched in the current subtree since the last call to
+   the count of its job, and let the subtree run for a share of what is
+   left of the budget of the job (at most PS_NODE_CHUNK nodes) before
+   calling again. Return 0 once that budget is used up (so that the
+   subtree is to be given up), after calling ps_pool_cancel_nodes. */
+#define PS_NODE_CHUNK 4096
+
+static int ps_worker_charge(ps_worker_t *w) {
+  ps_pool_t *pool = w->pool;
+  int job = w->current->job;
+  long nodes, grant;
+
+  if (pool->max_nodes[job] == -1) return(1);
+  nodes = __atomic_add_fetch(pool->nodes + job, w->current->count - w->charged,
+			     __ATOMIC_RELAXED);
+  w->charged = w->current->count;
+  if (nodes >= pool->max_nodes[job]) {
+    ps_pool_cancel_nodes(pool);
+    return(0);
+  }
+  grant = (pool->max_nodes[job] - nodes) / pool->num_threads + 1;
+  if (grant > PS_NODE_CHUNK) grant = PS_NODE_CHUNK;
+  w->current->count_limit = w->current->count + grant;
+  return(1);
+}
+
+/* Look for work belonging to other workers. If none is available,
+   ask a busy worker to split its subtree, and return NULL. */
+static ps_dynamic_data_t *ps_pool_steal(ps_worker_t *w) {
+  ps_pool_t *pool = w->pool;
+  ps_worker_t *v;
+  ps_dynamic_data_t *dy_data = NULL;
+  int i, np = pool->num_threads;
+
+  if (np == 1) return(NULL);
+  for (i=0; i<np && dy_data==NULL; i++) {
+    v = pool->workers + rand_r(&w->seed) % np;
+    if (v == w || deque_is_empty(v)) continue;
+    pthread_mutex_lock(&v->lock);
+    dy_data = deque_pop_head(v);
+    pthread_mutex_unlock(&v->lock);
+  }
+  if (dy_data == NULL) {
+    v = pool->workers + rand_r(&w->seed) % np;
+    if (v != w && __atomic_load_n(&v->busy, __ATOMIC_RELAXED))
+      __atomic_store_n(&v->interrupt, 1, __ATOMIC_RELAXED);
+  }
+  return(dy_data);
+}
+
+/* Wait until the pool is resumed. */
+static void ps_worker_park(ps_worker_t *w) {
+  ps_pool_t *pool = w->pool;
+
+  if (pool->sink != NULL && !ps_sink_flush(&w->sink_buf))
+    ps_pool_cancel(pool, PS_POOL_WRITE);
+  pthread_mutex_lock(&pool->pause_lock);
+  pool->paused += 1;
+  pthread_cond_broadcast(&pool->pause_cond);
+  while (pool->pause)
+    pthread_cond_wait(&pool->pause_cond, &pool->pause_lock);
+  pool->paused -= 1;
+  pthread_mutex_unlock(&pool->pause_lock);
+}
+
+/* Add the counts of the current subtree to the totals of w, which other
+   threads read as it runs, and release the subtree. */
+static void ps_worker_retire(ps_worker_t *w) {
+  __atomic_add_fetch(&w->count, w->current->count, __ATOMIC_RELEASE);
+  __atomic_add_fetch(w->job_count + w->current->job, w->current->count,
+		     __ATOMIC_RELEASE);
+  __atomic_add_fetch(&w->solutions, w->current->solutions, __ATOMIC_RELEASE);
+  ps_stats_add(w->stats, w->current->stats, w->pool->d);
+  ps_dynamic_clear(w->current);
+  w->current = NULL;
+}
+
+/* Be done with the current subtree, finished or given up. */
+static void ps_worker_drop(ps_worker_t *w) {
+  __atomic_store_n(&w->busy, 0, __ATOMIC_RELAXED);
+  ps_worker_retire(w);
+  __atomic_sub_fetch(&w->pool->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void *ps_worker_run(void *arg) {
+  ps_worker_t *w = (ps_worker_t *)arg;
+  ps_pool_t *pool = w->pool;
+  ps_dynamic_data_t *dy_data2;
+  long found;
+  int t;
+
+  while (!__atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+    if (__atomic_load_n(&pool->pause, __ATOMIC_ACQUIRE)) {
+      ps_worker_park(w);
+      continue;
+    }
+    if (w->current == NULL) {
+      pthread_mutex_lock(&w->lock);
+      w->current = deque_pop_tail(w);
+      pthread_mutex_unlock(&w->lock);
+      if (w->current == NULL) w->current = ps_pool_steal(w);
+      if (w->current == NULL) {
+	if (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0) break;
+	ps_pool_backoff();
+	continue;
+      }
+      w->current->interrupt = &w->interrupt;
+      __atomic_store_n(&w->busy, 1, __ATOMIC_RELAXED);
+      w->charged = w->current->count;
+      if (!ps_worker_charge(w)) {
+	ps_worker_drop(w);
+	continue;
+      }
+    }
+
+    t = next_pol(pool->jobs[w->current->job], w->current);
+    if (t > 0) {
+      if (pool->max_solutions != -1) {
+	/* Drop any solution beyond the limit. */
+	found = __atomic_add_fetch(&pool->found, 1, __ATOMIC_RELAXED);
+	if (found >= pool->max_solutions)
+	  ps_pool_cancel(pool, PS_POOL_SOLUTIONS);
+	if (found > pool->max_solutions) continue;
+      }
+      if (pool->sink == NULL) ps_pool_push_solution(pool, w->current);
+      else if (!ps_sink_add(&w->sink_buf, w->current))
+	ps_pool_cancel(pool, PS_POOL_WRITE);
+    }
+    else if (t == -2) {
+      if (w->current->count_limit != -1 &&
+	  w->current->count >= w->current->count_limit &&
+	  !ps_worker_charge(w)) {
+	ps_worker_drop(w);
+	continue;
+      }
+      if (!__atomic_load_n(&w->interrupt, __ATOMIC_RELAXED)) continue;
+      __atomic_store_n(&w->interrupt, 0, __ATOMIC_RELAXED);
+      if (__atomic_load_n(&pool->pause, __ATOMIC_ACQUIRE) ||
+	  __atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) continue;
+      /* Someone asked for work: split off part of our subtree. */
+      dy_data2 = ps_dynamic_split(w->current);
+      if (dy_data2 != NULL) {
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&w->lock);
+	deque_push(w, dy_data2);
+	pthread_mutex_unlock(&w->lock);
+      }
+    } else {
+      /* A subtree reaching the node limit of its static data (t == -1)
+	 has used up the budget of its job, which covers the subtree, so
+	 that ps_worker_charge gives up the job. */
+      ps_worker_charge(w);
+      ps_worker_drop(w);
+    }
+  }
+
+  if (w->current != NULL) ps_worker_retire(w);
+  if (pool->sink != NULL && !ps_sink_flush(&w->sink_buf))
+    ps_pool_cancel(pool, PS_POOL_WRITE);
+  pthread_mutex_lock(&pool->pause_lock);
+  pool->running -= 1;
+  pthread_cond_broadcast(&pool->pause_cond);
+  pthread_mutex_unlock(&pool->pause_lock);
+  return(NULL);
+}
+
+static ps_pool_t *ps_pool_start(ps_static_data_t **jobs, int num_jobs,
+				ps_dynamic_data_t **states, int num_states,
+				int num_threads, ps_sink_t *sink,
+				long max_solutions) {
+  ps_pool_t *pool;
+  ps_worker_t *w;
+  int i;
+
+  if (num_threads < 1) num_threads = 1;
+  pool = (ps_pool_t *)malloc(sizeof(ps_pool_t));
+  pool->st_data = jobs[0];
+  pool->d = jobs[0]->d;
+  pool->num_jobs = num_jobs;
+  pool->jobs = (ps_static_data_t **)malloc(num_jobs*sizeof(ps_static_data_t *));
+  memcpy(pool->jobs, jobs, num_jobs*sizeof(ps_static_data_t *));
+  pool->num_threads = num_threads;
+  pool->stop = 0;
+  pool->pause = 0;
+  pool->paused = 0;
+  pthread_mutex_init(&pool->pause_lock, NULL);
+  pthread_cond_init(&pool->pause_cond, NULL);
+  pool->solutions = NULL;
+  pool->drained = NULL;
+  pool->sink = sink;
+  pool->max_solutions = max_solutions;
+  pool->found = 0;
+  pool->max_nodes = (long *)malloc(num_jobs*sizeof(long));
+  pool->nodes = (long *)calloc(num_jobs, sizeof(long));
+  for (i=0; i<num_jobs; i++) pool->max_nodes[i] = jobs[i]->node_count;
+  for (i=0; i<num_states; i++) pool->nodes[states[i]->job] += states[i]->count;
+  pool->reached = 0;
+  pool->workers = (ps_worker_t *)malloc(num_threads*sizeof(ps_worker_t));
+  for (i=0; i<num_threads; i++) {
+    w = pool->workers + i;
+    w->pool = pool;
+    pthread_mutex_init(&w->lock, NULL);
+    w->size = 16;
+    w->deque = (ps_dynamic_data_t **)malloc(w->size*sizeof(ps_dynamic_data_t *));
+    w->head = 0;
+    w->tail = 0;
+    w->current = NULL;
+    w->busy = 0;
+    w->interrupt = 0;
+    w->count = 0;
+    w->solutions = 0;
+    w->charged = 0;
+    w->job_count = (long *)calloc(num_jobs, sizeof(long));
+    w->stats = NULL;
+    if (ps_stats_enabled())
+      w->stats = (ps_stats_t *)calloc(pool->d+1, sizeof(ps_stats_t));
+    w->seed = i+1;
+    if (sink != NULL) ps_sink_buffer_init(&w->sink_buf, sink);
+  }
+  for (i=0; i<num_states; i++)
+    deque_push(pool->workers + i%num_threads, ps_dynamic_clone(states[i]));
+  pool->pending = num_states;
+  pool->running = num_threads;
+
+  for (i=0; i<num_threads; i++)
+    pthread_create(&pool->workers[i].thread, NULL, ps_worker_run,
+		   pool->workers + i);
+  return(pool);
+}
+
+/* Start num_threads workers on the given subtrees. The pool works
+   on copies of the states, which are left untouched. */
+ps_pool_t *ps_pool_init(ps_static_data_t *st_data, ps_dynamic_data_t **states,
+			int num_states, int num_threads) {
+  return(ps_pool_init_sink(st_data, states, num_states, num_threads, NULL));
+}
+
+/* As ps_pool_init, but if sink is not NULL, write the solutions to it;
+   ps_pool_next_solution then only reports when the search is over. */
+ps_pool_t *ps_pool_init_sink(ps_static_data_t *st_data,
+			     ps_dynamic_data_t **states, int num_states,
+			     int num_threads, ps_sink_t *sink) {
+  return(ps_pool_init_limit(st_data, states, num_states, num_threads, sink,
+			    -1));
+}
+
+/* As ps_pool_init_sink, but stop once max_solutions solutions (if not
+   -1) have been found; only these are reported. The node_count of
+   st_data, if not -1, is a budget for the pool as a whole, including the
+   nodes already counted in the states. See ps_pool_reached. */
+ps_pool_t *ps_pool_init_limit(ps_static_data_t *st_data,
+			      ps_dynamic_data_t **states, int num_states,
+			      int num_threads, ps_sink_t *sink,
+			      long max_solutions) {
+  return(ps_pool_start(&st_data, 1, states, num_states, num_threads, sink,
+		       max_solutions));
+}
+
+/* Start num_threads workers on a batch of searches: states[i] is searched
+   with the static data jobs[states[i]->job]. All of these must have the
+   same d. Use ps_pool_next_job_solution and ps_pool_job_count to tell the
+   jobs apart; such a pool cannot be checkpointed. The node_count of each
+   job, if not -1, is a budget for that job as a whole: a job using it
+   up is given up, while the others run on (see ps_pool_job_reached). */
+ps_pool_t *ps_pool_init_batch(ps_static_data_t **jobs, int num_jobs,
+			      ps_dynamic_data_t **states, int num_states,
+			      int num_threads) {
+  return(ps_pool_start(jobs, num_jobs, states, num_states, num_threads, NULL,
+		       -1));
+}
+
+/* Wait for the next solution and copy it into Q (of length 2*d+3).
+   Return values:
+    1: if a solution has been found
+    0: if the tree has been exhausted
+   -1: if no solution is available yet, and either the pool is paused
+       or about a tenth of a second has passed
+   Only one thread may call this function. */
+int ps_pool_next_solution(ps_pool_t *pool, int *Q) {
+  return(ps_pool_next_job_solution(pool, Q, NULL));
+}
+
+/* As ps_pool_next_solution, also setting *job (if job is not NULL) to
+   the job the solution belongs to. */
+int ps_pool_next_job_solution(ps_pool_t *pool, int *Q, int *job) {
+  ps_solution_t *s, *list;
+  int done, i;
+
+  for (i=0; pool->drained == NULL; i++) {
+    done = (__atomic_load_n(&pool->running, __ATOMIC_ACQUIRE) == 0);
+    list = __atomic_exchange_n(&pool->solutions, NULL, __ATOMIC_ACQUIRE);
+    while (list != NULL) {
+      s = list;
+      list = s->next;
+      s->next = pool->drained;
+      pool->drained = s;
+    }
+    if (pool->drained == NULL) {
+      if (done) return(0);
+      if (i >= 2000 || __atomic_load_n(&pool->paused, __ATOMIC_ACQUIRE) ==
+	  __atomic_load_n(&pool->running, __ATOMIC_ACQUIRE)) return(-1);
+      ps_pool_backoff();
+    }
+  }
+  s = pool->drained;
+  pool->drained = s->next;
+  memcpy(Q, s->Q, (2*pool->d+3)*sizeof(int));
+  if (job != NULL) *job = s->job;
+  free(s);
+  return(1);
+}
+
+long ps_pool_count(ps_pool_t *pool) {
+  long count = 0;
+  int i;
+  for (i=0; i<pool->num_threads; i++)
+    count += __atomic_load_n(&pool->workers[i].count, __ATOMIC_ACQUIRE);
+  return(count);
+}
+
+/* The number of solutions counted in count-only mode (see
+   ps_static_set_count_only) in the subtrees finished so far. */
+long ps_pool_solution_count(ps_pool_t *pool) {
+  long solutions = 0;
+  int i;
+  for (i=0; i<pool->num_threads; i++)
+    solutions += __atomic_load_n(&pool->workers[i].solutions, __ATOMIC_ACQUIRE);
+  return(solutions);
+}
+
+/* Return 0 if the search has run its course, and otherwise the limit
+   which stopped it (PS_POOL_SOLUTIONS or PS_POOL_NODES), or PS_POOL_WRITE
+   if the sink failed (see ps_sink_error). Once the pool has
+   been stopped, ps_pool_next_solution returns 0 after the last solution,
+   and ps_pool_count is the number of nodes actually searched. In a
+   batch, PS_POOL_NODES means that some job used up its budget. */
+int ps_pool_reached(ps_pool_t *pool) {
+  return(__atomic_load_n(&pool->reached, __ATOMIC_ACQUIRE));
+}
+
+/* Return 1 if job used up its node budget, so that its search was cut
+   short, and 0 otherwise. */
+int ps_pool_job_reached(ps_pool_t *pool, int job) {
+  return(pool->max_nodes[job] != -1 &&
+	 __atomic_load_n(pool->nodes + job, __ATOMIC_ACQUIRE) >=
+	 pool->max_nodes[job]);
+}
+
+long ps_pool_job_count(ps_pool_t *pool, int job) {
+  long count = 0;
+  int i;
+  for (i=0; i<pool->num_threads; i++)
+    count += __atomic_load_n(pool->workers[i].job_count + job, __ATOMIC_ACQUIRE);
+  return(count);
+}
+
+/* Add the counters of the pool to res (of length d+1); the pool must
+   be paused or finished. Unlike ps_pool_count, this does not include
+   the initial states, as clones start with zero counters. */
+void ps_pool_stats(ps_pool_t *pool, ps_stats_t *res) {
+  ps_worker_t *w;
+  int i;
+  for (i=0; i<pool->num_threads; i++) {
+    w = pool->workers + i;
+    ps_stats_add(res, w->stats, pool->d);
+    if (w->current != NULL) ps_stats_add(res, w->current->stats, pool->d);
+  }
+}
+
+/* Ask all workers to park, and wait until they have done so. */
+void ps_pool_pause(ps_pool_t *pool) {
+  int i;
+
+  pthread_mutex_lock(&pool->pause_lock);
+  __atomic_store_n(&pool->pause, 1, __ATOMIC_RELEASE);
+  for (i=0; i<pool->num_threads; i++)
+    __atomic_store_n(&pool->workers[i].interrupt, 1, __ATOMIC_RELAXED);
+  while (pool->paused < pool->running)
+    pthread_cond_wait(&pool->pause_cond, &pool->pause_lock);
+  pthread_mutex_unlock(&pool->pause_lock);
+}
+
+void ps_pool_resume(ps_pool_t *pool) {
+  pthread_mutex_lock(&pool->pause_lock);
+  __atomic_store_n(&pool->pause, 0, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&pool->pause_cond);
+  pthread_mutex_unlock(&pool->pause_lock);
+}
+
+/* Write all live subtrees to a checkpoint file; the pool must be paused.
+   Here count is the number of nodes in subtrees finished outside the pool,
+   and solutions the number of solutions reported so far; in count-only
+   mode, those counted by the pool are added.
+   Return 1 on success, 0 on failure (always, for a batch). */
+int ps_pool_checkpoint(ps_pool_t *pool, const char *filename,
+		       long count, long solutions, long offset) {
+  ps_dynamic_data_t **states;
+  ps_worker_t *w;
+  int i, j, num_states = 0, r;
+
+  if (pool->num_jobs > 1) return(0);
+  for (i=0; i<pool->num_threads; i++) {
+    w = pool->workers + i;
+    num_states += w->tail - w->head + (w->current != NULL);
+  }
+  states = (ps_dynamic_data_t **)malloc((num_states+1)*sizeof(ps_dynamic_data_t *));
+  num_states = 0;
+  for (i=0; i<pool->num_threads; i++) {
+    w = pool->workers + i;
+    if (w->current != NULL) states[num_states++] = w->current;
+    for (j=w->head; j<w->tail; j++) states[num_states++] = w->deque[j];
+  }
+  r = ps_checkpoint_write(filename, pool->st_data, states, num_states,
+			  count + ps_pool_count(pool),
+			  solutions + ps_pool_solution_count(pool), offset);
+  free(states);
+  return(r);
+}
+
+/* Stop all workers (if they are still running) and release the pool. */
+void ps_pool_clear(ps_pool_t *pool) {
+  ps_worker_t *w;
+  ps_solution_t *s;
+  int i;
+
+  __atomic_store_n(&pool->stop, 1, __ATOMIC_RELAXED);
+  for (i=0; i<pool->num_threads; i++)
+    __atomic_store_n(&pool->workers[i].interrupt, 1, __ATOMIC_RELAXED);
+  ps_pool_resume(pool);
+  for (i=0; i<pool->num_threads; i++) {
+    w = pool->workers + i;
+    pthread_join(w->thread, NULL);
+    while (w->head < w->tail) ps_dynamic_clear(deque_pop_tail(w));
+    free(w->deque);
+    free(w->job_count);
+    free(w->stats);
+    if (pool->sink != NULL) ps_sink_buffer_clear(&w->sink_buf);
+    pthread_mutex_destroy(&w->lock);
+  }
+  while (pool->drained != NULL) {
+    s = pool->drained;
+    pool->drained = s->next;
+    free(s);
+  }
+  while (pool->solutions != NULL) {
+    s = pool->solutions;
+    pool->solutions = s->next;
+    free(s);
+  }
+  pthread_mutex_destroy(&pool->pause_lock);
+  pthread_cond_destroy(&pool->pause_cond);
+  free(pool->workers);
+  free(pool->jobs);
+  free(pool->max_nodes);
+  free(pool->nodes);
+  free(pool);
+}
@@ -0,0 +1,105 @@
+#ifndef WORK_STEALING
+#define WORK_STEALING
+
+#include <pthread.h>
+#include "power_sums.h"
+#include "solution_file.h"
+
+/* A solution waiting to be collected by the caller.
+   Q holds the 2*d+3 coefficients of the symmetrized polynomial. */
+typedef struct ps_solution {
+  struct ps_solution *next;
+  int job;
+  int Q[];
+} ps_solution_t;
+
+/* Each worker owns a deque of subtrees. The owner pushes and pops at the
+   tail; thieves take from the head, where the largest subtrees sit. */
+typedef struct ps_worker {
+  struct ps_pool *pool;
+  pthread_t thread;
+  pthread_mutex_t lock; /* protects the deque */
+  ps_dynamic_data_t **deque;
+  int head, tail, size;
+  ps_dynamic_data_t *current;
+  int busy;      /* nonzero while the worker is running next_pol */
+  int interrupt; /* set by thieves to ask for a split */
+  long count;
+  long solutions; /* solutions counted in count-only mode */
+  long charged; /* part of current->count added to pool->nodes[job] */
+  long *job_count; /* count split by job */
+  ps_stats_t *stats; /* totals over finished subtrees, or NULL */
+  unsigned int seed;
+  ps_sink_buffer_t sink_buf; /* used if the pool writes to a sink */
+} ps_worker_t;
+
+typedef struct ps_pool {
+  ps_static_data_t *st_data;
+  int d, num_threads;
+
+  /* The static data for each job; a state is searched with the static
+     data jobs[state->job]. Unless the pool runs a batch (see
+     ps_pool_init_batch), there is one job, st_data. */
+  ps_static_data_t **jobs;
+  int num_jobs;
+
+  int stop;     /* set to make all workers give up */
+  ps_worker_t *workers;
+  long pending; /* number of subtrees not yet exhausted */
+  int running;  /* number of worker threads not yet finished */
+
+  /* While pause is set, workers park; paused counts them. */
+  int pause, paused;
+  pthread_mutex_t pause_lock;
+  pthread_cond_t pause_cond;
+
+  /* Solutions are pushed by the workers onto a lock-free stack, which
+     the (single) consumer detaches in one step and reverses. */
+  ps_solution_t *solutions;
+  ps_solution_t *drained;
+
+  /* If set, solutions are written here instead. */
+  ps_sink_t *sink;
+
+  /* Limits on the search, or -1: found counts the solutions so far, and
+     nodes[job] the nodes of each job charged against its budget
+     max_nodes[job] (see ps_worker_charge). Once a limit is hit, or a
+     chunk of solutions cannot be written to the sink, reached records
+     why and every worker stops at its next split point, except that in
+     a batch, only the job over its budget is given up. */
+  long max_solutions, found;
+  long *max_nodes, *nodes;
+  int reached;
+} ps_pool_t;
+
+#define PS_POOL_SOLUTIONS 1
+#define PS_POOL_NODES 2
+#define PS_POOL_WRITE 3
+
+ps_pool_t *ps_pool_init(ps_static_data_t *st_data, ps_dynamic_data_t **states,
+			int num_states, int num_threads);
+ps_pool_t *ps_pool_init_sink(ps_static_data_t *st_data,
+			     ps_dynamic_data_t **states, int num_states,
+			     int num_threads, ps_sink_t *sink);
+ps_pool_t *ps_pool_init_limit(ps_static_data_t *st_data,
+			      ps_dynamic_data_t **states, int num_states,
+			      int num_threads, ps_sink_t *sink,
+			      long max_solutions);
+ps_pool_t *ps_pool_init_batch(ps_static_data_t **jobs, int num_jobs,
+			      ps_dynamic_data_t **states, int num_states,
+			      int num_threads);
+int ps_pool_next_solution(ps_pool_t *pool, int *Q);
+int ps_pool_next_job_solution(ps_pool_t *pool, int *Q, int *job);
+long ps_pool_count(ps_pool_t *pool);
+long ps_pool_solution_count(ps_pool_t *pool);
+long ps_pool_job_count(ps_pool_t *pool, int job);
+int ps_pool_reached(ps_pool_t *pool);
+int ps_pool_job_reached(ps_pool_t *pool, int job);
+void ps_pool_stats(ps_pool_t *pool, ps_stats_t *res);
+void ps_pool_pause(ps_pool_t *pool);
+void ps_pool_resume(ps_pool_t *pool);
+int ps_pool_checkpoint(ps_pool_t *pool, const char *filename,
+		       long count, long solutions, long offset);
+void ps_pool_clear(ps_pool_t *pool);
+
+#endif